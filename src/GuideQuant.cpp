@@ -1,5 +1,6 @@
 #include "plugin.hpp"
 #include "common/CVQuantizer.hpp"
+#include "common/ExpanderBus.hpp"
 
 struct GuideQuant : Module 
 {
@@ -35,37 +36,63 @@ struct GuideQuant : Module
 		configInput(GUIDE_INPUT, "Polyphonic guide input");
 		configInput(UNQUANTIZED_INPUT, "Input to be quantized");
 		configOutput(QUANTIZED_OUTPUT, "Quantized output");
+		ExpanderBus::attachConsumer(this, expanderMessages);
 	}
 
 	CVGuidedQuantizer quant;
+	ExpanderMessage expanderMessages[2];
 
 	float inputToBeQuantized;
 	uint8_t noteNumber;
 	uint8_t scaleNumber;
-	uint8_t numGuideNotes;
-	float* guideNotesArray; 
-
+	uint8_t numGuideNotes = 0;
+	float* guideNotesArray = nullptr;
+
+	/**
+	 * A SemitoneSequencer directly to the left stands in for unconnected inputs:
+	 * its CV for the input to be quantized, one channel per voice, and its scale
+	 * for the guide notes.
+	 */
 	void process(const ProcessArgs& args) override 
 	{
-		if (!(inputs[UNQUANTIZED_INPUT].isConnected()) || !(inputs[QUANTIZED_OUTPUT].isConnected()))
+		const ExpanderMessage* message = ExpanderBus::receive(this);
+		bool busInput = message && !inputs[UNQUANTIZED_INPUT].isConnected();
+		if (!(inputs[UNQUANTIZED_INPUT].isConnected() || busInput) || !(outputs[QUANTIZED_OUTPUT].isConnected()))
 			return;
 
-		inputToBeQuantized = inputs[UNQUANTIZED_INPUT].getVoltage() * params[RANGE_PARAM].getValue();
 		noteNumber = static_cast<uint8_t>(params[DEFAULT_ROOT_NOTE_PARAM].getValue());
 		scaleNumber = static_cast<uint8_t>(params[DEFAULT_SCALE_PARAM].getValue());
 
 		if (inputs[GUIDE_INPUT].isConnected())
 		{
-			numGuideNotes = inputs[GUIDE_INPUT].getChannels();
+			numGuideNotes = std::min(inputs[GUIDE_INPUT].getChannels(), 12);
 			guideNotesArray = inputs[GUIDE_INPUT].getVoltages();
 		}
-		else
+		else if (message && message->numGuideNotes > 0)
 		{
-            
+			numGuideNotes = message->numGuideNotes;
+			guideNotesArray = const_cast<float*>(message->guideNotes);
 		}
 
+		if (!guideNotesArray || numGuideNotes == 0)
+			return;
 		quant.SetAllowedNotes(guideNotesArray, numGuideNotes);
-		outputs[QUANTIZED_OUTPUT].setVoltage(quant.quantize(inputToBeQuantized));
+
+		if (busInput)
+		{
+			for (int c = 0; c < message->channels; ++c)
+			{
+				inputToBeQuantized = message->cv[c] * params[RANGE_PARAM].getValue();
+				outputs[QUANTIZED_OUTPUT].setVoltage(quant.quantize(inputToBeQuantized), c);
+			}
+			outputs[QUANTIZED_OUTPUT].setChannels(message->channels);
+		}
+		else
+		{
+			inputToBeQuantized = inputs[UNQUANTIZED_INPUT].getVoltage() * params[RANGE_PARAM].getValue();
+			outputs[QUANTIZED_OUTPUT].setVoltage(quant.quantize(inputToBeQuantized));
+			outputs[QUANTIZED_OUTPUT].setChannels(1);
+		}
 	}
 };
 
@@ -1,5 +1,27 @@
+#include <atomic>
 #include <string>
 #include "plugin.hpp"
+#include "common/REMath.hpp"
+#include "common/FMEngine.hpp"
+#include "common/Decimator.hpp"
+#include "common/Envelope.hpp"
+#include "common/BlockRamp.hpp"
+
+
+/** Names the shapes a waveform knob morphs between. */
+struct WaveformQuantity : ParamQuantity {
+	std::string getDisplayValueString() override {
+		static const char* names[] = {"Sine", "Triangle", "Saw", "Square"};
+		float value = clamp(getValue(), 0.f, 3.f);
+		int shape = static_cast<int>(value);
+		float morph = value - shape;
+		if (morph < 0.005f || shape == 3)
+			return names[shape];
+		if (morph > 0.995f)
+			return names[shape + 1];
+		return string::f("%s > %s %.0f%%", names[shape], names[shape + 1], morph * 100.f);
+	}
+};
 
 
 struct PolyOsc : Module {
@@ -41,6 +63,29 @@ struct PolyOsc : Module {
 		MIX_OSC_3_PARAM,
 		MIX_OSC_4_PARAM,
 		MIX_MASTER_PARAM,
+		PW_OSC_1_PARAM,
+		PW_OSC_2_PARAM,
+		PW_OSC_3_PARAM,
+		PW_OSC_4_PARAM,
+		ATTACK_OSC_1_PARAM,
+		ATTACK_OSC_2_PARAM,
+		ATTACK_OSC_3_PARAM,
+		ATTACK_OSC_4_PARAM,
+		DECAY_OSC_1_PARAM,
+		DECAY_OSC_2_PARAM,
+		DECAY_OSC_3_PARAM,
+		DECAY_OSC_4_PARAM,
+		SUSTAIN_OSC_1_PARAM,
+		SUSTAIN_OSC_2_PARAM,
+		SUSTAIN_OSC_3_PARAM,
+		SUSTAIN_OSC_4_PARAM,
+		RELEASE_OSC_1_PARAM,
+		RELEASE_OSC_2_PARAM,
+		RELEASE_OSC_3_PARAM,
+		RELEASE_OSC_4_PARAM,
+		UNISON_PARAM,
+		UNISON_DETUNE_PARAM,
+		UNISON_SPREAD_PARAM,
 		PARAMS_LEN
 	};
 	enum InputId {
@@ -60,6 +105,7 @@ struct PolyOsc : Module {
 		OUT_OSC_3_OUTPUT,
 		OUT_OSC_4_OUTPUT,
 		OUT_MIX_OUTPUT,
+		OUT_MIX_RIGHT_OUTPUT,
 		OUTPUTS_LEN
 	};
 	enum LightId {
@@ -68,61 +114,405 @@ struct PolyOsc : Module {
 
 	PolyOsc() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
-        for (int i = 0; i < 16; ++i) {
-		    configParam(OCT_OSC_1_PARAM + i, -4.0f, 4.0f, 0.f, "Octave Osc " + std::to_string(i + 1), "octave", );
-        }
-		configParam(SEMI_OSC_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FINE_OSC_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(WAVEFORM_OSC_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_4_MOD_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_4_MOD_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_4_MOD_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_4_MOD_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(OCT_OSC_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(SEMI_OSC_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FINE_OSC_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(WAVEFORM_OSC_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_3_MOD_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_3_MOD_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_3_MOD_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_3_MOD_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(OCT_OSC_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(SEMI_OSC_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FINE_OSC_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(WAVEFORM_OSC_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_2_MOD_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_2_MOD_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_2_MOD_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_2_MOD_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(OCT_OSC_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(SEMI_OSC_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FINE_OSC_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(WAVEFORM_OSC_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_1_MOD_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_1_MOD_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_1_MOD_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(FM_1_MOD_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(MIX_OSC_1_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(MIX_OSC_2_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(MIX_OSC_3_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(MIX_OSC_4_PARAM, 0.f, 1.f, 0.f, "");
-		configParam(MIX_MASTER_PARAM, 0.f, 1.f, 0.f, "");
-		configInput(V_OCT_OSC_1_INPUT, "");
-		configInput(V_OCT_OSC_2_INPUT, "");
-		configInput(V_OCT_OSC_3_INPUT, "");
-		configInput(V_OCT_OSC_4_INPUT, "");
-		configInput(GATE_OSC_1_INPUT, "");
-		configInput(GATE_OSC_2_INPUT, "");
-		configInput(GATE_OSC_3_INPUT, "");
-		configInput(GATE_OSC_4_INPUT, "");
-		configOutput(OUT_OSC_1_OUTPUT, "");
-		configOutput(OUT_OSC_2_OUTPUT, "");
-		configOutput(OUT_OSC_3_OUTPUT, "");
-		configOutput(OUT_OSC_4_OUTPUT, "");
-		configOutput(OUT_MIX_OUTPUT, "");
+		for (int i = 0; i < 4; ++i) {
+			std::string osc = "Osc " + std::to_string(i + 1);
+			configParam(OCT_OSC_1_PARAM + i, -4.f, 4.f, 0.f, osc + " octave")->snapEnabled = true;
+			configParam(SEMI_OSC_1_PARAM + i, -12.f, 12.f, 0.f, osc + " semitone", " semitones")->snapEnabled = true;
+			configParam(FINE_OSC_1_PARAM + i, -1.f, 1.f, 0.f, osc + " fine tune", " cents", 0.f, 100.f);
+			configParam<WaveformQuantity>(WAVEFORM_OSC_1_PARAM + i, 0.f, 3.f, 0.f, osc + " waveform");
+			configParam(PW_OSC_1_PARAM + i, 0.05f, 0.95f, 0.5f, osc + " pulse width", "%", 0.f, 100.f)->description = "Pulse waveform in Shapes mode only";
+			configParam(ATTACK_OSC_1_PARAM + i, 0.f, 1.f, 0.f, osc + " attack", " ms", ENVELOPE_TIME_RANGE, 1.f);
+			configParam(DECAY_OSC_1_PARAM + i, 0.f, 1.f, 0.5f, osc + " decay", " ms", ENVELOPE_TIME_RANGE, 1.f);
+			configParam(SUSTAIN_OSC_1_PARAM + i, 0.f, 1.f, 1.f, osc + " sustain", "%", 0.f, 100.f);
+			configParam(RELEASE_OSC_1_PARAM + i, 0.f, 1.f, 0.5f, osc + " release", " ms", ENVELOPE_TIME_RANGE, 1.f);
+			for (int m = 0; m < 4; ++m)
+				configParam(FM_1_MOD_1_PARAM + i * 4 + m, 0.f, 1.f, 0.f, "Osc " + std::to_string(m + 1) + " to " + osc + " FM", "%", 0.f, 100.f);
+			configParam(MIX_OSC_1_PARAM + i, 0.f, 1.f, (i == 0) ? 1.f : 0.f, osc + " mix level", "%", 0.f, 100.f);
+			configInput(V_OCT_OSC_1_INPUT + i, osc + " V/Oct");
+			configInput(GATE_OSC_1_INPUT + i, osc + " envelope gate");
+			configOutput(OUT_OSC_1_OUTPUT + i, osc);
+		}
+		configParam(MIX_MASTER_PARAM, 0.f, 1.f, 0.8f, "Master level", "%", 0.f, 100.f);
+		configParam(UNISON_PARAM, 1.f, FMOperatorBank::MAX_UNISON, 1.f, "Unison", " copies")->snapEnabled = true;
+		configParam(UNISON_DETUNE_PARAM, 0.f, 1.f, 0.2f, "Unison detune", " cents", 0.f, 100.f);
+		configParam(UNISON_SPREAD_PARAM, 0.f, 1.f, 0.5f, "Unison stereo spread", "%", 0.f, 100.f);
+		configOutput(OUT_MIX_OUTPUT, "Mix left/mono");
+		configOutput(OUT_MIX_RIGHT_OUTPUT, "Mix right");
+
+		paramDivider.setDivision(PARAM_BLOCK);
+		for (int op = 0; op < 4; ++op) {
+			for (int b = 0; b < FMOperatorBank::NUM_VOICE_BLOCKS; ++b) {
+				lastOctave[op][b] = 0.f;
+				frequency[op][b] = dsp::FREQ_C4;
+				lastGate[op][b] = 0.f;
+			}
+		}
+		wavetable = Wavetable::acquire();
+		operators.setWavetable(wavetable.get());
+		setWaveformMode(FMOperatorBank::SHAPES);
+	}
+
+	FMOperatorBank operators;
+	std::shared_ptr<const Wavetable> wavetable;
+	dsp::ClockDivider paramDivider;
+
+	/**
+	 * The operators run at oversampling times the engine rate, and every
+	 * patched output is decimated back down, one decimator per output and block
+	 * of voices, after the unison copies are summed. The menu sets
+	 * pendingOversampling and the engine picks it up, so the decimators are
+	 * only ever touched from the engine thread.
+	 */
+	static const int NUM_OUTPUTS = OUTPUTS_LEN;
+	int oversampling = 1;
+	std::atomic<int> pendingOversampling{1};
+	OversamplingDecimator decimators[NUM_OUTPUTS][FMOperatorBank::NUM_VOICE_BLOCKS];
+
+	/** Set by the menu, and handed to the operators by updateParams(). */
+	std::atomic<int> pendingFMMode{FMOperatorBank::PHASE_MODULATION};
+	std::atomic<int> pendingInterpolation{FMOperatorBank::LINEAR};
+
+	/** Envelope times run from 1 ms to 10 s, as 1 ms * ENVELOPE_TIME_RANGE^knob. */
+	static constexpr float ENVELOPE_TIME_RANGE = 10000.f;
+	ADSRCoefficients envelopeShapes[4];
+	ADSREnvelope envelopes[4][FMOperatorBank::NUM_VOICE_BLOCKS];
+	simd::float_4 lastGate[4][FMOperatorBank::NUM_VOICE_BLOCKS];
+
+	/**
+	 * The knobs are read once every PARAM_BLOCK samples. Those that reach the
+	 * audio directly ramp across the block, in groups of four: a row of the FM
+	 * matrix, the mix levels, the pulse widths, the waveforms and the master
+	 * level. The waveforms only ramp in wavetable mode. Pitch, envelope and
+	 * unison settings step at block rate.
+	 */
+	static const int PARAM_BLOCK = 32;
+	enum RampedParam {
+		RAMP_FM = 0,
+		RAMP_MIX = 16,
+		RAMP_PULSE_WIDTH = 20,
+		RAMP_WAVEFORM = 24,
+		RAMP_MASTER = 28,
+		NUM_RAMPED = 32
+	};
+	BlockRamp<NUM_RAMPED> ramps;
+	int routing = 0;
+
+	/** Values the engine reads, set by updateParams() and applyRamps(). */
+	int activeOperators = -1;
+	float pitch[4] = {};
+	float pulseWidth[4] = {};
+	simd::float_4 mixLevels = 0.f;
+	float masterLevel = 0.f;
+
+	/**
+	 * Every block of voices owns MAX_UNISON operator blocks, with copy c at
+	 * b * MAX_UNISON + c, so changing the unison count never moves a copy onto
+	 * another voice's state. The copies share the voices' pitch and envelopes and
+	 * only differ by a frequency ratio and a pan. The gains include
+	 * 1 / sqrt(unison), which keeps the level of uncorrelated copies steady.
+	 */
+	int unison = 1;
+	float detuneRatios[FMOperatorBank::MAX_UNISON] = {};
+	float unisonGain = 1.f;
+	float panLeft[FMOperatorBank::MAX_UNISON] = {};
+	float panRight[FMOperatorBank::MAX_UNISON] = {};
+
+	/** Each operator's pitch in octaves from C4, and the frequency it was last converted to. */
+	simd::float_4 lastOctave[4][FMOperatorBank::NUM_VOICE_BLOCKS];
+	simd::float_4 frequency[4][FMOperatorBank::NUM_VOICE_BLOCKS];
+
+	/** Converts an envelope time knob to seconds. */
+	static float envelopeTime(float knob) {
+		return 0.001f * TAR::Math::fastExp2(knob * std::log2(ENVELOPE_TIME_RANGE));
+	}
+
+	/**
+	 * Reads every knob and starts the ramps towards them. Operators that reach
+	 * no patched output, directly or through the matrix, are switched off.
+	 *
+	 * Until a ramp ends, both where it starts and where it ends count, so an
+	 * entry or operator fading out stays in the routing until it reaches 0.
+	 */
+	void updateParams(float sampleTime) {
+		float targets[NUM_RAMPED] = {};
+		for (int i = 0; i < 4; ++i) {
+			pitch[i] = params[OCT_OSC_1_PARAM + i].getValue() + (params[SEMI_OSC_1_PARAM + i].getValue() + params[FINE_OSC_1_PARAM + i].getValue()) / 12.f;
+			targets[RAMP_WAVEFORM + i] = params[WAVEFORM_OSC_1_PARAM + i].getValue();
+			targets[RAMP_MIX + i] = params[MIX_OSC_1_PARAM + i].getValue();
+			targets[RAMP_PULSE_WIDTH + i] = params[PW_OSC_1_PARAM + i].getValue();
+			for (int m = 0; m < 4; ++m)
+				targets[RAMP_FM + i * 4 + m] = params[FM_1_MOD_1_PARAM + i * 4 + m].getValue();
+			envelopeShapes[i].set(envelopeTime(params[ATTACK_OSC_1_PARAM + i].getValue()), envelopeTime(params[DECAY_OSC_1_PARAM + i].getValue()),
+				params[SUSTAIN_OSC_1_PARAM + i].getValue(), envelopeTime(params[RELEASE_OSC_1_PARAM + i].getValue()), sampleTime);
+		}
+		targets[RAMP_MASTER] = params[MIX_MASTER_PARAM].getValue();
+
+		float held[NUM_RAMPED];
+		for (int k = 0; k < NUM_RAMPED; ++k)
+			held[k] = std::max(targets[k], ramps.get(k));
+		simd::float_4 heldRows[4];
+		for (int n = 0; n < 4; ++n)
+			heldRows[n] = simd::float_4::load(&held[RAMP_FM + n * 4]);
+		routing = FMOperatorBank::routingOf(heldRows);
+		ramps.snapshot(targets, PARAM_BLOCK);
+		/** Shapes snap, so a ramp would play every shape between the old one and the new. */
+		if (operators.getWaveformMode() == FMOperatorBank::SHAPES)
+			ramps.jump(RAMP_WAVEFORM / 4);
+
+		/** Copies are spread evenly from -detune to +detune, and panned in the same order. */
+		int newUnison = clamp((int)params[UNISON_PARAM].getValue(), 1, FMOperatorBank::MAX_UNISON);
+		/** A copy coming back would still hold the output it had when it was dropped. */
+		for (int c = unison; c < newUnison; ++c) {
+			for (int b = 0; b < FMOperatorBank::NUM_VOICE_BLOCKS; ++b)
+				operators.clear(b * FMOperatorBank::MAX_UNISON + c);
+		}
+		unison = newUnison;
+		float detune = params[UNISON_DETUNE_PARAM].getValue() / 12.f;
+		float spread = params[UNISON_SPREAD_PARAM].getValue();
+		unisonGain = 1.f / std::sqrt((float)unison);
+		for (int c = 0; c < unison; ++c) {
+			float position = (unison > 1) ? 2.f * c / (unison - 1) - 1.f : 0.f;
+			detuneRatios[c] = TAR::Math::fastExp2(detune * position);
+			float angle = (1.f + spread * position) * float(M_PI) / 4.f;
+			panLeft[c] = unisonGain * std::cos(angle);
+			panRight[c] = unisonGain * std::sin(angle);
+		}
+
+		bool mixPatched = outputs[OUT_MIX_OUTPUT].isConnected() || outputs[OUT_MIX_RIGHT_OUTPUT].isConnected();
+		int active = 0;
+		for (int op = 0; op < 4; ++op) {
+			if (outputs[OUT_OSC_1_OUTPUT + op].isConnected() || (mixPatched && held[RAMP_MIX + op] * held[RAMP_MASTER] > 0.f))
+				active |= 1 << op;
+		}
+		/** A modulator of an active operator is active too. Three passes follow the longest chain. */
+		for (int pass = 0; pass < 3; ++pass) {
+			for (int n = 0; n < 4; ++n) {
+				for (int m = 0; m < 4; ++m) {
+					if ((active & (1 << n)) && held[RAMP_FM + n * 4 + m] > 0.f)
+						active |= 1 << m;
+				}
+			}
+		}
+		if (active != activeOperators) {
+			activeOperators = active;
+			operators.setActiveOperators(active);
+		}
+
+		/** The FM mode sets the matrix depth, so it changes just before the matrix is set again. */
+		if (pendingFMMode != operators.getFMMode())
+			operators.setFMMode(pendingFMMode);
+		if (pendingInterpolation != operators.getInterpolation())
+			operators.setInterpolation(pendingInterpolation);
+		applyRamps(-1);
+	}
+
+	/** Hands the ramped values in the groups set in moved to the operators and the mix. */
+	void applyRamps(int moved) {
+		const simd::float_4* groups = ramps.groups();
+		if (moved & (0xf << (RAMP_FM / 4)))
+			operators.setMatrix(groups + RAMP_FM / 4, routing);
+		if (moved & (1 << (RAMP_MIX / 4)))
+			mixLevels = groups[RAMP_MIX / 4];
+		if (moved & (1 << (RAMP_PULSE_WIDTH / 4))) {
+			for (int i = 0; i < 4; ++i)
+				pulseWidth[i] = groups[RAMP_PULSE_WIDTH / 4].s[i];
+		}
+		if (moved & (1 << (RAMP_WAVEFORM / 4)))
+			operators.setWaveforms(groups[RAMP_WAVEFORM / 4].s);
+		if (moved & (1 << (RAMP_MASTER / 4)))
+			masterLevel = groups[RAMP_MASTER / 4].s[0];
 	}
 
+	/**
+	 * Shapes snap the waveform knobs to the four shapes, and the wavetable lets
+	 * them morph.
+	 */
+	void setWaveformMode(int mode) {
+		operators.setWaveformMode(mode);
+		for (int i = 0; i < 4; ++i)
+			paramQuantities[WAVEFORM_OSC_1_PARAM + i]->snapEnabled = (mode == FMOperatorBank::SHAPES);
+	}
+
+	void setOversampling(int factor) {
+		oversampling = factor;
+		for (int output = 0; output < NUM_OUTPUTS; ++output) {
+			for (int b = 0; b < FMOperatorBank::NUM_VOICE_BLOCKS; ++b)
+				decimators[output][b].setFactor(factor);
+		}
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "oversampling", json_integer(pendingOversampling.load()));
+		json_object_set_new(rootJ, "waveform_mode", json_integer(operators.getWaveformMode()));
+		json_object_set_new(rootJ, "wavetable_interpolation", json_integer(pendingInterpolation.load()));
+		json_object_set_new(rootJ, "fm_mode", json_integer(pendingFMMode.load()));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ) {
+			int factor = json_integer_value(oversamplingJ);
+			if (factor == 1 || factor == 2 || factor == 4 || factor == 8)
+				pendingOversampling = factor;
+		}
+		json_t* waveformModeJ = json_object_get(rootJ, "waveform_mode");
+		if (waveformModeJ)
+			setWaveformMode(clamp((int)json_integer_value(waveformModeJ), 0, FMOperatorBank::NUM_WAVEFORM_MODES - 1));
+		json_t* interpolationJ = json_object_get(rootJ, "wavetable_interpolation");
+		if (interpolationJ)
+			pendingInterpolation = clamp((int)json_integer_value(interpolationJ), 0, FMOperatorBank::NUM_INTERPOLATIONS - 1);
+		json_t* fmModeJ = json_object_get(rootJ, "fm_mode");
+		if (fmModeJ)
+			pendingFMMode = clamp((int)json_integer_value(fmModeJ), 0, FMOperatorBank::NUM_FM_MODES - 1);
+	}
+
+	/**
+	 * Returns the input an operator listens to: its own if patched, otherwise the
+	 * nearest patched one above it, or -1 if there is none.
+	 */
+	int normalledInput(int firstInput, int op) {
+		for (int i = op; i >= 0; --i) {
+			if (inputs[firstInput + i].isConnected())
+				return firstInput + i;
+		}
+		return -1;
+	}
+
+	/**
+	 * One voice per poly channel, up to 16, with four operators each. Unpatched
+	 * V/Oct and gate inputs are normalled down from the operator above, and an
+	 * operator with no gate at all holds its envelope at sustain.
+	 *
+	 * A block of four voices whose active operators' envelopes are all idle is
+	 * asleep: the operators skip it and its outputs are 0 with no decimation.
+	 * The envelopes only go idle below -80 dB, so nothing audible is cut.
+	 *
+	 * With unison, every copy of a voice starts from a random phase when its
+	 * gate goes high. The mix output is mono unless the right output is patched.
+	 */
 	void process(const ProcessArgs& args) override {
+		if (paramDivider.process())
+			updateParams(args.sampleTime);
+		if (int moved = ramps.process())
+			applyRamps(moved);
+		if (pendingOversampling != oversampling)
+			setOversampling(pendingOversampling);
+
+		int channels = 1;
+		int voctInput[4], gateInput[4];
+		for (int op = 0; op < 4; ++op) {
+			voctInput[op] = normalledInput(V_OCT_OSC_1_INPUT, op);
+			gateInput[op] = normalledInput(GATE_OSC_1_INPUT, op);
+			channels = std::max(channels, inputs[V_OCT_OSC_1_INPUT + op].getChannels());
+			channels = std::max(channels, inputs[GATE_OSC_1_INPUT + op].getChannels());
+		}
+		const int numBlocks = (channels + 3) / 4;
+		const float sampleTime = args.sampleTime / oversampling;
+
+		bool awake[FMOperatorBank::NUM_VOICE_BLOCKS] = {};
+		int awakeBlocks[FMOperatorBank::NUM_BLOCKS];
+		int numAwake = 0;
+		for (int b = 0; b < numBlocks; ++b) {
+			const int firstCopy = b * FMOperatorBank::MAX_UNISON;
+			for (int op = 0; op < 4; ++op) {
+				if (!(activeOperators & (1 << op)))
+					continue;
+
+				simd::float_4 gate = (gateInput[op] >= 0)
+					? inputs[gateInput[op]].getPolyVoltageSimd<simd::float_4>(b * 4) >= 1.f
+					: simd::float_4::mask();
+				int triggered = simd::movemask(gate & ~lastGate[op][b]);
+				lastGate[op][b] = gate;
+				ADSREnvelope& envelope = envelopes[op][b];
+				if (envelope.isIdle() && !simd::movemask(gate)) {
+					for (int c = 0; c < unison; ++c)
+						operators.level[op][firstCopy + c] = 0.f;
+					continue;
+				}
+				simd::float_4 level = envelope.process(gate, envelopeShapes[op]);
+				awake[b] = true;
+
+				simd::float_4 voct = (voctInput[op] >= 0) ? inputs[voctInput[op]].getPolyVoltageSimd<simd::float_4>(b * 4) : 0.f;
+				simd::float_4 octave = pitch[op] + voct;
+				if (simd::movemask(octave != lastOctave[op][b])) {
+					lastOctave[op][b] = octave;
+					frequency[op][b] = dsp::FREQ_C4 * TAR::Math::fastExp2(octave);
+				}
+				simd::float_4 increment = frequency[op][b] * sampleTime;
+				for (int c = 0; c < unison; ++c) {
+					operators.increment[op][firstCopy + c] = simd::clamp(increment * detuneRatios[c], 0.f, 0.5f);
+					operators.level[op][firstCopy + c] = level;
+					operators.pulseWidth[op][firstCopy + c] = pulseWidth[op];
+				}
+
+				if (unison > 1 && triggered) {
+					for (int lane = 0; lane < 4; ++lane) {
+						if (triggered & (1 << lane)) {
+							for (int c = 0; c < unison; ++c)
+								operators.setPhase(op, firstCopy + c, lane, random::u32());
+						}
+					}
+				}
+			}
+
+			for (int c = 0; c < unison; ++c) {
+				if (awake[b])
+					awakeBlocks[numAwake++] = firstCopy + c;
+				else
+					operators.clear(firstCopy + c);
+			}
+		}
+
+		bool connected[NUM_OUTPUTS];
+		for (int output = 0; output < NUM_OUTPUTS; ++output)
+			connected[output] = outputs[output].isConnected();
+		const bool stereo = connected[OUT_MIX_RIGHT_OUTPUT];
+
+		simd::float_4 samples[NUM_OUTPUTS][FMOperatorBank::NUM_VOICE_BLOCKS][OversamplingDecimator::MAX_FACTOR];
+		for (int i = 0; i < oversampling; ++i) {
+			/** Eight voices at a time where there are enough, then four. */
+			int k = 0;
+			for (; k + 1 < numAwake; k += 2)
+				operators.process<2>(&awakeBlocks[k]);
+			for (; k < numAwake; ++k)
+				operators.process<1>(&awakeBlocks[k]);
+
+			for (int b = 0; b < numBlocks; ++b) {
+				if (!awake[b])
+					continue;
+				const int firstCopy = b * FMOperatorBank::MAX_UNISON;
+				simd::float_4 left = 0.f, right = 0.f;
+				for (int op = 0; op < 4; ++op) {
+					simd::float_4 sum = 0.f;
+					for (int c = 0; c < unison; ++c)
+						sum += operators.out[op][firstCopy + c];
+					samples[OUT_OSC_1_OUTPUT + op][b][i] = unisonGain * sum;
+				}
+				for (int c = 0; c < unison; ++c) {
+					simd::float_4 mix = 0.f;
+					for (int op = 0; op < 4; ++op)
+						mix += mixLevels.s[op] * operators.out[op][firstCopy + c];
+					left += ((stereo) ? panLeft[c] : unisonGain) * mix;
+					right += panRight[c] * mix;
+				}
+				samples[OUT_MIX_OUTPUT][b][i] = masterLevel * left;
+				samples[OUT_MIX_RIGHT_OUTPUT][b][i] = masterLevel * right;
+			}
+		}
+
+		for (int output = 0; output < NUM_OUTPUTS; ++output) {
+			if (!connected[output])
+				continue;
+			for (int b = 0; b < numBlocks; ++b) {
+				simd::float_4 voltage = (awake[b]) ? 5.f * decimators[output][b].process(samples[output][b]) : 0.f;
+				outputs[output].setVoltageSimd(voltage, b * 4);
+			}
+		}
+
+		for (int output = 0; output < NUM_OUTPUTS; ++output)
+			outputs[output].setChannels(channels);
 	}
 };
 
@@ -169,11 +559,34 @@ struct PolyOscWidget : ModuleWidget {
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(90.285, 63.865)), module, PolyOsc::FM_1_MOD_2_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(103.864, 63.865)), module, PolyOsc::FM_1_MOD_3_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(117.763, 63.865)), module, PolyOsc::FM_1_MOD_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(65.769, 18.69)), module, PolyOsc::PW_OSC_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(65.769, 33.748)), module, PolyOsc::PW_OSC_3_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(65.769, 48.806)), module, PolyOsc::PW_OSC_2_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(65.769, 63.865)), module, PolyOsc::PW_OSC_1_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(20.103, 26.22)), module, PolyOsc::ATTACK_OSC_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(33.222, 26.22)), module, PolyOsc::DECAY_OSC_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(46.961, 26.22)), module, PolyOsc::SUSTAIN_OSC_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(59.84, 26.22)), module, PolyOsc::RELEASE_OSC_4_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(20.103, 41.278)), module, PolyOsc::ATTACK_OSC_3_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(33.222, 41.278)), module, PolyOsc::DECAY_OSC_3_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(46.961, 41.278)), module, PolyOsc::SUSTAIN_OSC_3_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(59.84, 41.278)), module, PolyOsc::RELEASE_OSC_3_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(20.103, 56.336)), module, PolyOsc::ATTACK_OSC_2_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(33.222, 56.336)), module, PolyOsc::DECAY_OSC_2_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(46.961, 56.336)), module, PolyOsc::SUSTAIN_OSC_2_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(59.84, 56.336)), module, PolyOsc::RELEASE_OSC_2_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(20.103, 71.395)), module, PolyOsc::ATTACK_OSC_1_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(33.222, 71.395)), module, PolyOsc::DECAY_OSC_1_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(46.961, 71.395)), module, PolyOsc::SUSTAIN_OSC_1_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(59.84, 71.395)), module, PolyOsc::RELEASE_OSC_1_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(70.056, 89.073)), module, PolyOsc::MIX_OSC_1_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(82.738, 89.073)), module, PolyOsc::MIX_OSC_2_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(95.42, 89.073)), module, PolyOsc::MIX_OSC_3_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(108.102, 89.073)), module, PolyOsc::MIX_OSC_4_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(120.785, 89.073)), module, PolyOsc::MIX_MASTER_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(76.397, 98.79)), module, PolyOsc::UNISON_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(89.079, 98.79)), module, PolyOsc::UNISON_DETUNE_PARAM));
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(101.761, 98.79)), module, PolyOsc::UNISON_SPREAD_PARAM));
 
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(13.774, 90.677)), module, PolyOsc::V_OCT_OSC_1_INPUT));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(26.432, 90.677)), module, PolyOsc::V_OCT_OSC_2_INPUT));
@@ -189,6 +602,25 @@ struct PolyOscWidget : ModuleWidget {
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(95.42, 108.506)), module, PolyOsc::OUT_OSC_3_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(108.102, 108.506)), module, PolyOsc::OUT_OSC_4_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(120.785, 108.506)), module, PolyOsc::OUT_MIX_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(120.785, 118.8)), module, PolyOsc::OUT_MIX_RIGHT_OUTPUT));
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		PolyOsc* module = getModule<PolyOsc>();
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createIndexSubmenuItem("FM mode", {"Phase", "Linear through-zero"},
+			[=]() { return module->pendingFMMode.load(); },
+			[=](int mode) { module->pendingFMMode = mode; }));
+		menu->addChild(createIndexSubmenuItem("Waveforms", {"Shapes", "Wavetable morph"},
+			[=]() { return module->operators.getWaveformMode(); },
+			[=](int mode) { module->setWaveformMode(mode); }));
+		menu->addChild(createIndexSubmenuItem("Oversampling", {"1x", "2x", "4x", "8x"},
+			[=]() { return (int)std::log2(module->pendingOversampling.load()); },
+			[=](int index) { module->pendingOversampling = 1 << index; }));
+		menu->addChild(createIndexSubmenuItem("Wavetable interpolation", {"Linear", "Cubic"},
+			[=]() { return module->pendingInterpolation.load(); },
+			[=](int interpolation) { module->pendingInterpolation = interpolation; }));
 	}
 };
 
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <vector>
+#include <osdialog.h>
 #include "SemitoneSequencer.hpp"
+#include "common/PatternOverview.hpp"
 
 /**
  * @struct TuningModulator
@@ -9,7 +13,7 @@
  * This struct is responsible for all three detuning modes.
  */
 
-TuningModulator::TuningModulator() : m_Phase(0.0f){};
+TuningModulator::TuningModulator(){};
 
 float TuningModulator::randomSquareLFO(bool gate)
 {
@@ -21,38 +25,6 @@ float TuningModulator::randomSquareLFO(bool gate)
         return 0.0f;
 }
 
-float TuningModulator::sineLFO(float pitch, float sampleTime, float pitchAttenuation)
-{
-    float freq = 0.5f * std::pow(2.0f, pitch * pitchAttenuation);
-    m_Phase += freq * sampleTime;
-    if (m_Phase >= 0.5f)
-        m_Phase -= 1.0f;
-    return simd::sin(2.0f * M_PI * m_Phase);
-}
-
-float TuningModulator::randomSmoothLFO(float currentValue, float lastValue, float phase)
-{
-    float v = 0;
-    v = std::fmin(phase, 1.f);
-    v = std::cos(M_PI * v);
-    v = rescale(v, 1.0f, -1.0f, lastValue, currentValue);
-    return v * 2.0f - 1.0f;
-}
-
-struct CVSlider
-{
-    float durationInSamples = 0;
-
-    float slide(float nextNote, float currentNote, float sampleTime, float slideSpeed)
-    {
-        float cvDifference = nextNote - currentNote;
-        float stepDuration = (60.0f / slideSpeed);
-        durationInSamples = stepDuration / sampleTime;
-        float CVToAddPerSample = cvDifference / durationInSamples;
-        return CVToAddPerSample;
-    }
-};
-
 /**
  * @struct SemitoneSequencer
  * @brief the main module class where IO and params are configured.
@@ -92,12 +64,40 @@ SemitoneSequencer::SemitoneSequencer()
     configParam(SWING_PARAM, 1.0f, 10.0f, 1.0f, "Swing ratio");
     configParam(GATE_PROBABILITY_PARAM, 0.0f, 1.0f, 1.0f, "Gate probability", "%", 0.0f, 100.0f);
     configParam /* <SlideParam> */ (SLIDE_PARAM, 0.0f, 1.0f, 0.0f, "Slide rate", "", 0.0f, 1.0f);
+
+    /**
+     * The 96 fake params hold the pattern. Rather than replacing the quantities \n
+     * config() already made for them, those are made unbounded, which also keeps \n
+     * Rack from saving them. The pattern is saved as one blob in dataToJson.
+     */
     for (int i = 0; i < 32; ++i)
     {
-        configParam(FAKE_OCT_PARAM + i, -4.f, 4.f, 0.f, "");
-        configParam(FAKE_SEMITONE_PARAM + i, 0.f, 11.f, 0.f, "");
-        configParam(FAKE_STEP_ACTIVE_PARAM + i, 0.0f, 1.0f, 1.0f, "");
+        for (int id : {FAKE_OCT_PARAM + i, FAKE_SEMITONE_PARAM + i, FAKE_STEP_ACTIVE_PARAM + i})
+        {
+            paramQuantities[id]->minValue = -INFINITY;
+            paramQuantities[id]->maxValue = INFINITY;
+            paramQuantities[id]->randomizeEnabled = false;
+        }
+        paramQuantities[FAKE_STEP_ACTIVE_PARAM + i]->defaultValue = 1.0f;
+        params[FAKE_STEP_ACTIVE_PARAM + i].setValue(1.0f);
+    }
+    configInput(PATTERN_SELECT_INPUT, "Pattern select");
+
+    /** User grooves start out straight. */
+    for (int i = 0; i < NUM_USER_GROOVES; ++i)
+    {
+        userGrooves[i] = BUILT_IN_GROOVES[0];
+        std::snprintf(userGrooves[i].name, sizeof(userGrooves[i].name), "User %d", i + 1);
+        for (int step = 1; step < GrooveTemplate::MAX_STEPS; ++step)
+            userGrooves[i].gateLength[step] = 0.5f;
     }
+
+    for (int i = 0; i < 32; ++i)
+        stepRatchets[i] = 1;
+    for (int i = 0; i < 4; ++i)
+        audioRatePhase[i] = 0.f;
+    audioRateDivider.setDivision(AUDIO_RATE_DIVISION);
+    snapshotDivider.setDivision(SNAPSHOT_DIVISION);
 }
 
 /**
@@ -113,8 +113,13 @@ void SemitoneSequencer::onReset()
     detuneMode = RANDOM_GATE;
     quantizationMode = 0;
     stepNumber = 0;
+    paramLocks.clearAll();
+    activeLocks = 0;
+    gateScheduler.reset();
     for (int i = 0; i < 32; ++i)
     {
+        stepRatchets[i] = 1;
+        stepRatchetCurves[i] = RATCHET_EVEN;
         params[FAKE_OCT_PARAM + i].setValue(0.0f);
         params[FAKE_SEMITONE_PARAM + i].setValue(0.0f);
     }
@@ -140,24 +145,6 @@ void SemitoneSequencer::onRandomize()
     quantizationMode = 0;
 }
 
-/**
- * Similar to the previous two functions, this initializes all the variables that \n
- * are necessary for functionality but which aren't tied to parameters, meaning they \n
- * are not automatically initialized. This avoids several critical bugs that otherwise \n
- * result in crashes.
- */
-void SemitoneSequencer::onAdd()
-{
-    if (numMeasures == 69)
-    {
-        running = false;
-        numStepsPerMeasure = 8;
-        numMeasures = 4;
-        detuneMode = RANDOM_GATE;
-        quantizationMode = 0;
-    }
-}
-
 /** Stores non-parameter variables in the json file. */
 json_t *SemitoneSequencer::dataToJson()
 {
@@ -169,6 +156,27 @@ json_t *SemitoneSequencer::dataToJson()
     /** Current step number */
     json_object_set_new(rootJ, "current_step_number", json_integer(stepNumber));
 
+    /**
+     * Pattern, as base64 of a version byte, three reserved bytes and a \n
+     * PatternRecord, the same record pattern libraries store.
+     */
+    float octaves[32];
+    float semitones[32];
+    float stepActive[32];
+    for (int i = 0; i < 32; ++i)
+    {
+        octaves[i] = params[FAKE_OCT_PARAM + i].getValue();
+        semitones[i] = params[FAKE_SEMITONE_PARAM + i].getValue();
+        stepActive[i] = params[FAKE_STEP_ACTIVE_PARAM + i].getValue();
+    }
+    PatternRecord record;
+    record.fromArrays(octaves, semitones, stepActive);
+    record.numStepsPerMeasure = numStepsPerMeasure;
+    record.numMeasures = numMeasures;
+    uint8_t blob[4 + sizeof(PatternRecord)] = {PATTERN_BLOB_VERSION};
+    std::memcpy(blob + 4, &record, sizeof(record));
+    json_object_set_new(rootJ, "pattern", json_string(string::toBase64(blob, sizeof(blob)).c_str()));
+
     /** Number of steps per measure*/
     json_object_set_new(rootJ, "Number of Steps", json_integer(numStepsPerMeasure));
 
@@ -184,6 +192,80 @@ json_t *SemitoneSequencer::dataToJson()
     /** Quantization mode */
     json_object_set_new(rootJ, "quantization_mode", json_integer(quantizationMode));
 
+    /** Groove */
+    json_object_set_new(rootJ, "groove", json_integer(grooveIndex));
+
+    /** User grooves */
+    json_t *userGroovesJ = json_array();
+    for (int i = 0; i < NUM_USER_GROOVES; ++i)
+    {
+        const GrooveTemplate &groove = userGrooves[i];
+        json_t *grooveJ = json_object();
+        json_t *offsetsJ = json_array();
+        json_t *gateLengthsJ = json_array();
+        for (int step = 0; step < groove.length; ++step)
+        {
+            json_array_append_new(offsetsJ, json_real(groove.offset[step]));
+            json_array_append_new(gateLengthsJ, json_real(groove.gateLength[step]));
+        }
+        json_object_set_new(grooveJ, "length", json_integer(groove.length));
+        json_object_set_new(grooveJ, "offsets", offsetsJ);
+        json_object_set_new(grooveJ, "gate_lengths", gateLengthsJ);
+        json_array_append_new(userGroovesJ, grooveJ);
+    }
+    json_object_set_new(rootJ, "user_grooves", userGroovesJ);
+
+    /** Parameter locks, as [step, lock, value] triples */
+    json_t *paramLocksJ = json_array();
+    for (int step = 0; step < ParamLocks::NUM_STEPS; ++step)
+    {
+        for (int lock = 0; lock < ParamLocks::NUM_LOCKS; ++lock)
+        {
+            if (!paramLocks.has(step, lock))
+                continue;
+            json_t *lockJ = json_array();
+            json_array_append_new(lockJ, json_integer(step));
+            json_array_append_new(lockJ, json_integer(lock));
+            json_array_append_new(lockJ, json_real(paramLocks.get(step, lock)));
+            json_array_append_new(paramLocksJ, lockJ);
+        }
+    }
+    json_object_set_new(rootJ, "param_locks", paramLocksJ);
+
+    /** Ratchets, as [count, curve] pairs per step */
+    json_t *ratchetsJ = json_array();
+    for (int step = 0; step < 32; ++step)
+    {
+        json_t *ratchetJ = json_array();
+        json_array_append_new(ratchetJ, json_integer(stepRatchets[step]));
+        json_array_append_new(ratchetJ, json_integer(stepRatchetCurves[step]));
+        json_array_append_new(ratchetsJ, ratchetJ);
+    }
+    json_object_set_new(rootJ, "ratchets", ratchetsJ);
+
+    /** LFO spread and decorrelation */
+    json_object_set_new(rootJ, "lfo_spread", json_real(lfoSpread));
+    json_object_set_new(rootJ, "lfo_decorrelation", json_real(lfoDecorrelation));
+
+    /** Random LFO kernel */
+    json_object_set_new(rootJ, "random_kernel", json_integer(randomLFO.getKernel()));
+
+    /** Slide curve */
+    json_object_set_new(rootJ, "slide_curve", json_integer(slew.getCurve()));
+
+    /** Slide mode and glide settings */
+    json_object_set_new(rootJ, "slide_mode", json_integer(slideMode));
+    json_object_set_new(rootJ, "glide_sync", json_boolean(glide.getSync()));
+    json_object_set_new(rootJ, "glide_legato", json_boolean(glide.getLegatoOnly()));
+
+    /** Audio rate mode */
+    json_object_set_new(rootJ, "audio_rate", json_boolean(audioRate));
+    json_object_set_new(rootJ, "audio_rate_band_limit", json_boolean(audioRateBandLimit));
+
+    /** Pattern library */
+    if (patternLibrary)
+        json_object_set_new(rootJ, "pattern_library", json_string(patternLibrary->path().c_str()));
+
     return rootJ;
 }
 
@@ -200,15 +282,48 @@ void SemitoneSequencer::dataFromJson(json_t *rootJ)
     if (stepNumberJ)
         stepNumber = json_integer_value(stepNumberJ);
 
+    /**
+     * Pattern. A blob that isn't a string or has the wrong size or version is \n
+     * skipped with a warning, and fromJson() falls back to the params array.
+     */
+    patternBlobLoaded = false;
+    json_t *patternJ = json_object_get(rootJ, "pattern");
+    if (json_is_string(patternJ))
+    {
+        std::vector<uint8_t> blob = string::fromBase64(json_string_value(patternJ));
+        if (blob.size() == 4 + sizeof(PatternRecord) && blob[0] == PATTERN_BLOB_VERSION)
+        {
+            patternBlobLoaded = true;
+            PatternRecord record;
+            std::memcpy(&record, blob.data() + 4, sizeof(record));
+            float octaves[32];
+            float semitones[32];
+            float stepActive[32];
+            record.toArrays(octaves, semitones, stepActive);
+            for (int i = 0; i < 32; ++i)
+            {
+                params[FAKE_OCT_PARAM + i].setValue(clamp(octaves[i], -4.0f, 4.0f));
+                params[FAKE_SEMITONE_PARAM + i].setValue(clamp(semitones[i], 0.0f, 11.0f));
+                params[FAKE_STEP_ACTIVE_PARAM + i].setValue(stepActive[i]);
+            }
+        }
+    }
+
+    if (patternJ && !patternBlobLoaded)
+        WARN("SemitoneSequencer: unusable pattern blob, reading the pattern from the params array");
+
     /** Number of steps per measure */
     json_t *numStepsJ = json_object_get(rootJ, "Number of Steps");
     if (numStepsJ)
-        numStepsPerMeasure = json_integer_value(numStepsJ);
+        numStepsPerMeasure = clamp((int)json_integer_value(numStepsJ), 1, 8);
 
     /** Number of measures */
     json_t *measuresJ = json_object_get(rootJ, "number_of_measures");
     if (measuresJ)
-        numMeasures = json_integer_value(measuresJ);
+        numMeasures = clamp((int)json_integer_value(measuresJ), 1, 4);
+
+    /** The step number was read before the pattern length it has to fit in. */
+    stepNumber = clamp(stepNumber, 0, numStepsPerMeasure * numMeasures - 1);
 
     /** Chord mode */
     json_t *chordModeJ = json_object_get(rootJ, "chord_mode");
@@ -224,6 +339,288 @@ void SemitoneSequencer::dataFromJson(json_t *rootJ)
     json_t *quantizationModeJ = json_object_get(rootJ, "quantization_mode");
     if (quantizationModeJ)
         quantizationMode = json_integer_value(quantizationModeJ);
+
+    /** Groove */
+    json_t *grooveJ = json_object_get(rootJ, "groove");
+    if (grooveJ)
+        grooveIndex = clamp((int)json_integer_value(grooveJ), 0, NUM_BUILT_IN_GROOVES + NUM_USER_GROOVES - 1);
+
+    /** User grooves */
+    json_t *userGroovesJ = json_object_get(rootJ, "user_grooves");
+    for (int i = 0; userGroovesJ && i < NUM_USER_GROOVES && i < (int)json_array_size(userGroovesJ); ++i)
+    {
+        GrooveTemplate &groove = userGrooves[i];
+        json_t *userGrooveJ = json_array_get(userGroovesJ, i);
+        json_t *lengthJ = json_object_get(userGrooveJ, "length");
+        json_t *offsetsJ = json_object_get(userGrooveJ, "offsets");
+        json_t *gateLengthsJ = json_object_get(userGrooveJ, "gate_lengths");
+        if (!lengthJ || !offsetsJ || !gateLengthsJ)
+            continue;
+
+        groove.length = clamp((int)json_integer_value(lengthJ), 1, GrooveTemplate::MAX_STEPS);
+        for (int step = 0; step < groove.length; ++step)
+        {
+            groove.offset[step] = clamp((float)json_number_value(json_array_get(offsetsJ, step)),
+                                        GrooveTemplate::MIN_OFFSET, GrooveTemplate::MAX_OFFSET);
+            groove.gateLength[step] = clamp((float)json_number_value(json_array_get(gateLengthsJ, step)), 0.0f, 1.0f);
+        }
+    }
+    grooveDirty = true;
+
+    /** Parameter locks */
+    json_t *paramLocksJ = json_object_get(rootJ, "param_locks");
+    if (paramLocksJ)
+    {
+        paramLocks.clearAll();
+        for (size_t i = 0; i < json_array_size(paramLocksJ); ++i)
+        {
+            json_t *lockJ = json_array_get(paramLocksJ, i);
+            int step = json_integer_value(json_array_get(lockJ, 0));
+            int lock = json_integer_value(json_array_get(lockJ, 1));
+            if (step < 0 || step >= ParamLocks::NUM_STEPS || lock < 0 || lock >= ParamLocks::NUM_LOCKS)
+                continue;
+            paramLocks.set(step, lock, json_number_value(json_array_get(lockJ, 2)));
+        }
+    }
+
+    /** Ratchets */
+    json_t *ratchetsJ = json_object_get(rootJ, "ratchets");
+    for (int step = 0; ratchetsJ && step < 32 && step < (int)json_array_size(ratchetsJ); ++step)
+    {
+        json_t *ratchetJ = json_array_get(ratchetsJ, step);
+        stepRatchets[step] = clamp((int)json_integer_value(json_array_get(ratchetJ, 0)), 1, MAX_RATCHETS);
+        stepRatchetCurves[step] = clamp((int)json_integer_value(json_array_get(ratchetJ, 1)), 0, NUM_RATCHET_CURVES - 1);
+    }
+
+    /** LFO spread and decorrelation */
+    json_t *lfoSpreadJ = json_object_get(rootJ, "lfo_spread");
+    if (lfoSpreadJ)
+        lfoSpread = clamp((float)json_number_value(lfoSpreadJ), 0.0f, 1.0f);
+    sineLFO.setSpread(lfoSpread);
+    json_t *lfoDecorrelationJ = json_object_get(rootJ, "lfo_decorrelation");
+    if (lfoDecorrelationJ)
+        lfoDecorrelation = clamp((float)json_number_value(lfoDecorrelationJ), 0.0f, 1.0f);
+
+    /** Random LFO kernel */
+    json_t *randomKernelJ = json_object_get(rootJ, "random_kernel");
+    if (randomKernelJ)
+        randomLFO.setKernel(clamp((int)json_integer_value(randomKernelJ), 0, SmoothRandomBank::NUM_KERNELS - 1));
+
+    /** Slide curve */
+    json_t *slideCurveJ = json_object_get(rootJ, "slide_curve");
+    if (slideCurveJ)
+        slew.setCurve(clamp((int)json_integer_value(slideCurveJ), 0, TSlewLimiter<simd::float_4>::NUM_CURVES - 1));
+
+    /** Slide mode and glide settings */
+    json_t *slideModeJ = json_object_get(rootJ, "slide_mode");
+    if (slideModeJ)
+        setSlideMode(json_integer_value(slideModeJ));
+    json_t *glideSyncJ = json_object_get(rootJ, "glide_sync");
+    if (glideSyncJ)
+        glide.setSync(json_is_true(glideSyncJ));
+    json_t *glideLegatoJ = json_object_get(rootJ, "glide_legato");
+    if (glideLegatoJ)
+        glide.setLegatoOnly(json_is_true(glideLegatoJ));
+
+    /** Audio rate mode */
+    json_t *audioRateJ = json_object_get(rootJ, "audio_rate");
+    if (audioRateJ)
+        audioRate = json_is_true(audioRateJ);
+    json_t *audioRateBandLimitJ = json_object_get(rootJ, "audio_rate_band_limit");
+    if (audioRateBandLimitJ)
+        audioRateBandLimit = json_is_true(audioRateBandLimitJ);
+
+    /** Pattern library */
+    json_t *patternLibraryJ = json_object_get(rootJ, "pattern_library");
+    if (json_is_string(patternLibraryJ))
+        loadPatternLibrary(json_string_value(patternLibraryJ));
+}
+
+/**
+ * Loads the module, then falls back to the pattern stored in the params array \n
+ * for patches saved before the pattern blob existed, or whose blob is unusable.
+ */
+void SemitoneSequencer::fromJson(json_t *rootJ)
+{
+    Module::fromJson(rootJ);
+
+    if (!patternBlobLoaded)
+        importLegacyPattern(json_object_get(rootJ, "params"));
+}
+
+/**
+ * Reads the fake params out of an old patch's params array. Rack skips them \n
+ * now that they're unbounded, so they have to be picked out by hand.
+ *
+ * @param paramsJ is the module's "params" array.
+ */
+void SemitoneSequencer::importLegacyPattern(json_t *paramsJ)
+{
+    for (size_t i = 0; paramsJ && i < json_array_size(paramsJ); ++i)
+    {
+        json_t *paramJ = json_array_get(paramsJ, i);
+        json_t *idJ = json_object_get(paramJ, "id");
+        json_t *valueJ = json_object_get(paramJ, "value");
+        int id = (idJ) ? json_integer_value(idJ) : static_cast<int>(i);
+        if (!valueJ)
+            continue;
+
+        bool isFake = (id >= FAKE_OCT_PARAM && id < FAKE_OCT_PARAM + 32) ||
+                      (id >= FAKE_SEMITONE_PARAM && id < FAKE_SEMITONE_PARAM + 32) ||
+                      (id >= FAKE_STEP_ACTIVE_PARAM && id < FAKE_STEP_ACTIVE_PARAM + 32);
+        if (isFake)
+            params[id].setValue(json_number_value(valueJ));
+    }
+}
+
+/**
+ * Maps a pattern library file and hands it to the audio thread, and frees the
+ * libraries the audio thread has confirmed it no longer reads. Called from the
+ * UI thread.
+ *
+ * @param path is the path of the library file.
+ * @return whether the library was loaded.
+ */
+bool SemitoneSequencer::loadPatternLibrary(const std::string &path)
+{
+    std::shared_ptr<const PatternLibrary> library = PatternLibrary::acquire(path);
+    if (!library)
+        return false;
+
+    const uint32_t acknowledged = acknowledgedPatternLibrary.load(std::memory_order_acquire);
+    retiredPatternLibraries.erase(
+        std::remove_if(retiredPatternLibraries.begin(), retiredPatternLibraries.end(),
+                       [=](const std::pair<uint32_t, std::shared_ptr<const PatternLibrary>> &retired)
+                       { return static_cast<int32_t>(acknowledged - retired.first) >= 0; }),
+        retiredPatternLibraries.end());
+
+    ++patternLibraryGeneration;
+    if (patternLibrary)
+        retiredPatternLibraries.emplace_back(patternLibraryGeneration, patternLibrary);
+    patternLibrary = library;
+    activePatternLibrary.store(patternLibrary.get(), std::memory_order_release);
+    sendCommand(SequencerCommand::ACKNOWLEDGE_PATTERN_LIBRARY, static_cast<int>(patternLibraryGeneration));
+    return true;
+}
+
+/**
+ * Queues an edit for the audio thread. Called from the UI thread. If the queue \n
+ * is full the edit is dropped, which only happens when hundreds of edits arrive \n
+ * within one engine block.
+ */
+void SemitoneSequencer::sendCommand(SequencerCommand::Type type, int index, int index2, float value)
+{
+    SequencerCommand command;
+    command.type = type;
+    command.index = index;
+    command.index2 = index2;
+    command.value = value;
+    commands.push(command);
+}
+
+/**
+ * Applies every queued edit from the UI thread, then brings the state that \n
+ * depends on them back in line: the step is kept inside the pattern, the current \n
+ * step's locks are looked up again, and the groove table is flagged for a rebuild.
+ */
+void SemitoneSequencer::applyCommands()
+{
+    SequencerCommand command;
+    bool structureChanged = false;
+    bool locksChanged = false;
+    while (commands.pop(command))
+    {
+        switch (command.type)
+        {
+        case SequencerCommand::SET_STEPS_PER_MEASURE:
+            numStepsPerMeasure = clamp(command.index, 1, 8);
+            structureChanged = true;
+            break;
+        case SequencerCommand::SET_NUM_MEASURES:
+            numMeasures = clamp(command.index, 1, 4);
+            structureChanged = true;
+            break;
+        case SequencerCommand::SET_CHORD_MODE:
+            chordMode = command.index;
+            break;
+        case SequencerCommand::SET_DETUNE_MODE:
+            detuneMode = command.index;
+            break;
+        case SequencerCommand::SET_QUANTIZATION_MODE:
+            quantizationMode = command.index;
+            break;
+        case SequencerCommand::SET_GROOVE:
+            grooveIndex = clamp(command.index, 0, NUM_BUILT_IN_GROOVES + NUM_USER_GROOVES - 1);
+            grooveDirty = true;
+            break;
+        case SequencerCommand::SET_USER_GROOVE_LENGTH:
+            userGrooves[command.index].length = clamp(command.index2, 1, GrooveTemplate::MAX_STEPS);
+            grooveDirty = true;
+            break;
+        case SequencerCommand::SET_USER_GROOVE_OFFSET:
+            userGrooves[command.index].offset[command.index2] = command.value;
+            grooveDirty = true;
+            break;
+        case SequencerCommand::SET_USER_GROOVE_GATE_LENGTH:
+            userGrooves[command.index].gateLength[command.index2] = command.value;
+            grooveDirty = true;
+            break;
+        case SequencerCommand::SET_PARAM_LOCK:
+            paramLocks.set(command.index, command.index2, command.value);
+            locksChanged = true;
+            break;
+        case SequencerCommand::CLEAR_PARAM_LOCK:
+            if (command.index2 < 0)
+                paramLocks.clearStep(command.index);
+            else
+                paramLocks.clear(command.index, command.index2);
+            locksChanged = true;
+            break;
+        case SequencerCommand::SET_RATCHETS:
+            stepRatchets[command.index] = clamp(command.index2, 1, MAX_RATCHETS);
+            break;
+        case SequencerCommand::SET_RATCHET_CURVE:
+            stepRatchetCurves[command.index] = clamp(command.index2, 0, NUM_RATCHET_CURVES - 1);
+            break;
+        case SequencerCommand::SET_AUDIO_RATE:
+            audioRate = command.index;
+            break;
+        case SequencerCommand::SET_AUDIO_RATE_BAND_LIMIT:
+            audioRateBandLimit = command.index;
+            break;
+        case SequencerCommand::SET_LFO_SPREAD:
+            lfoSpread = clamp(command.value, 0.0f, 1.0f);
+            sineLFO.setSpread(lfoSpread);
+            break;
+        case SequencerCommand::SET_LFO_DECORRELATION:
+            lfoDecorrelation = clamp(command.value, 0.0f, 1.0f);
+            break;
+        case SequencerCommand::SET_RANDOM_KERNEL:
+            randomLFO.setKernel(clamp(command.index, 0, SmoothRandomBank::NUM_KERNELS - 1));
+            break;
+        case SequencerCommand::SET_SLIDE_CURVE:
+            slew.setCurve(clamp(command.index, 0, TSlewLimiter<simd::float_4>::NUM_CURVES - 1));
+            break;
+        case SequencerCommand::SET_SLIDE_MODE:
+            setSlideMode(command.index);
+            break;
+        case SequencerCommand::SET_GLIDE_SYNC:
+            glide.setSync(command.index);
+            break;
+        case SequencerCommand::SET_GLIDE_LEGATO:
+            glide.setLegatoOnly(command.index);
+            break;
+        case SequencerCommand::ACKNOWLEDGE_PATTERN_LIBRARY:
+            /** Reads from here on see the new library, and earlier samples are done. */
+            acknowledgedPatternLibrary.store(static_cast<uint32_t>(command.index), std::memory_order_release);
+            break;
+        }
+    }
+
+    if (structureChanged && stepNumber >= numStepsPerMeasure * numMeasures)
+        stepNumber = 0;
+    if (locksChanged || structureChanged)
+        resolveLocks(patternStep(stepNumber));
 }
 
 /**
@@ -235,6 +632,7 @@ void SemitoneSequencer::dataFromJson(json_t *rootJ)
 void SemitoneSequencer::setStep(int stepNumber, int mode)
 {
     phase = 0.f;
+    stepSample = 0;
     this->stepNumber = stepNumber;
     if (seqMode == Forward)
     {
@@ -252,17 +650,495 @@ void SemitoneSequencer::setStep(int stepNumber, int mode)
     }
 }
 
-/** Resets the random LFO values. Needs work. */
-void SemitoneSequencer::resetRandLFO()
+/**
+ * Moves the playhead to the next active step, backwards in reverse mode, and
+ * draws new random values for the step.
+ *
+ * @param stepActive is the array of step active values for all 32 steps.
+ */
+void SemitoneSequencer::advanceStep(const float *stepActive)
+{
+    if (seqMode == Forward || seqMode == Random)
+    {
+        while (!(stepActive[stepNumber + numStepsToIncrement]))
+            ++numStepsToIncrement;
+
+        legato = numStepsToIncrement == 1;
+        setStep(stepNumber + 1, seqMode);
+        numStepsToIncrement = 1;
+    }
+    else
+    {
+        while (!(stepActive[stepNumber - numStepsToIncrement]))
+            ++numStepsToIncrement;
+
+        legato = numStepsToIncrement == 1;
+        setStep(stepNumber - numStepsToIncrement, seqMode);
+        numStepsToIncrement = 1;
+    }
+
+    randValue = random::uniform();
+    resolveLocks(patternStep(stepNumber));
+    ++stepCount;
+}
+
+/**
+ * Switches between the slew limiter and the two glide modes.
+ *
+ * @param mode is a SlideMode.
+ */
+void SemitoneSequencer::setSlideMode(int mode)
+{
+    slideMode = clamp(mode, 0, NUM_SLIDE_MODES - 1);
+    if (slideMode != SLIDE_SLEW)
+        glide.setMode((slideMode == SLIDE_GLIDE_RATE) ? GlideEngine::CONSTANT_RATE : GlideEngine::CONSTANT_TIME);
+}
+
+/**
+ * Looks up the parameter locks of a step. Called at step events only.
+ *
+ * @param step is the pattern step, measure * 8 + step, from 0 - 31.
+ */
+void SemitoneSequencer::resolveLocks(int step)
+{
+    activeLocks = paramLocks.mask[step];
+    for (int lock = 0; lock < ParamLocks::NUM_LOCKS; ++lock)
+    {
+        if (activeLocks & (1 << lock))
+            lockedValues[lock] = paramLocks.get(step, lock);
+    }
+}
+
+/**
+ * Schedules the gate edges of the step that just started, one on/off pair per \n
+ * ratchet. Each retrigger keeps the step's gate to length ratio within its own \n
+ * gap, and is always at least one sample long. Called at step events only.
+ *
+ * @param stepLength is the length of the step in samples.
+ * @param gateLength is the length of the step's gate in samples.
+ */
+void SemitoneSequencer::scheduleGates(int stepLength, int gateLength)
+{
+    gateScheduler.clear();
+    stepLength = std::max(stepLength, 1);
+    const int step = patternStep(stepNumber);
+    int count = stepRatchets[step];
+    if (count <= 1)
+    {
+        gateScheduler.push(sampleCounter, true);
+        gateScheduler.push(sampleCounter + gateLength, false);
+        return;
+    }
+
+    int curve = stepRatchetCurves[step];
+    float duty = clamp(static_cast<float>(gateLength) / stepLength, 0.0f, 1.0f);
+    int on = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int next = static_cast<int>(std::round(ratchetPosition(curve, i + 1, count) * stepLength));
+        int off = on + std::max(static_cast<int>(duty * (next - on)), 1);
+        if (i + 1 < count && off >= next)
+            off = next - 1;
+        if (off > on)
+        {
+            gateScheduler.push(sampleCounter + on, true);
+            gateScheduler.push(sampleCounter + off, false);
+        }
+        on = next;
+    }
+}
+
+/** Returns the selected groove, built-in or user. */
+const GrooveTemplate &SemitoneSequencer::currentGroove() const
+{
+    if (grooveIndex < NUM_BUILT_IN_GROOVES)
+        return BUILT_IN_GROOVES[grooveIndex];
+    return userGrooves[grooveIndex - NUM_BUILT_IN_GROOVES];
+}
+
+/**
+ * Rebuilds the groove table when the tempo, swing, sample rate or groove has \n
+ * changed. Otherwise this is just a few compares. The swing ratio r : 1 moves \n
+ * every odd step late by (r - 1) / (r + 1) of a step.
+ *
+ * @param sampleRate is the engine sample rate.
+ */
+void SemitoneSequencer::updateGrooveTable(float sampleRate)
 {
-    randLFOLastValue = randLFOValue;
+    float clock = params[CLOCK_PARAM].getValue();
+    float swing = params[SWING_PARAM].getValue();
+    if (clock == grooveClock && swing == grooveSwing && sampleRate == grooveSampleRate &&
+        !grooveDirty)
+        return;
+
+    grooveDirty = false;
+    grooveClock = clock;
+    grooveSwing = swing;
+    grooveSampleRate = sampleRate;
+
+    float swingOffset = (swing - 1.0f) / (swing + 1.0f);
+    grooveTable.build(currentGroove(), swingOffset, sampleRate / TAR::Math::fastExp2(clock));
+    grooveActive = grooveIndex != 0 || swing > 1.0f;
+    grooveStep %= grooveTable.length;
+    stepPhaseIncrement = 1.0f / grooveTable.stepSamples[grooveStep];
+    stepGateSamples = grooveTable.gateSamples[grooveStep];
+}
+
+/**
+ * Returns the pitch of a single step, quantized according to the current
+ * quantization mode.
+ *
+ * @param index is the step index, from 0 - 31.
+ * @param octaves is the array of octave values for all 32 steps.
+ * @param semitones is the array of semitone values for all 32 steps.
+ */
+float SemitoneSequencer::stepPitch(int index, const float *octaves, const float *semitones)
+{
+    float rawPitch = octaves[index] + semitones[index] / 12.0f;
+    if (quantizationMode == 0)
+        return rawPitch;
+
+    quantizer.semitoneRound(rawPitch);
+    return quantizer.setOutputVoltage();
+}
+
+/**
+ * Moves a lane to its next active step. Lanes never leave their own measure, and
+ * if every step in the measure is inactive the lane stays where it is.
+ *
+ * @param offset is the lane's current step within its measure.
+ * @param regionStart is the index of the first step of the lane's measure.
+ * @param stepActive is the array of step active values for all 32 steps.
+ * @return the lane's new step within its measure.
+ */
+int SemitoneSequencer::advanceLaneStep(int offset, int regionStart, const float *stepActive)
+{
+    for (int tries = 0; tries < numStepsPerMeasure; ++tries)
+    {
+        if (seqMode == Forward)
+            offset = (offset + 1) % numStepsPerMeasure;
+        else if (seqMode == Reverse)
+            offset = (offset + numStepsPerMeasure - 1) % numStepsPerMeasure;
+        else
+            offset = random::u32() % numStepsPerMeasure;
+
+        if (stepActive[regionStart + offset])
+            break;
+    }
+    return offset;
+}
+
+/**
+ * Runs the sequencer as up to 16 independent lanes, one per channel of the clock
+ * or reset input. Gate and CV outputs get one channel per lane. Chord mode does
+ * not apply here, and detuning is drawn once per step for each lane.
+ */
+void SemitoneSequencer::processLanes(const ProcessArgs &args, const float *octaves, const float *semitones, const float *stepActive)
+{
+    using simd::float_4;
+
+    const bool externalClock = inputs[CLOCK_INPUT].isConnected();
+    const float clockStep = TAR::Math::fastExp2(params[CLOCK_PARAM].getValue()) * args.sampleTime;
+    const float slide = params[SLIDE_PARAM].getValue();
+    const float slewRate = (slide > 0.0f) ? 1.0f / (1.0f + slide * args.sampleRate) : 0.0f;
+    const float gateProbability = params[GATE_PROBABILITY_PARAM].getValue();
+    const float detuneAmount = params[DETUNE_AMOUNT_PARAM].getValue() / 12.0f;
+    const bool anyLocks = paramLocks.any();
+
+    for (int c = 0; c < lanes.numLanes; c += 4)
+    {
+        const int b = c / 4;
+        float_4 advance;
+        float_4 gateHigh;
+
+        if (externalClock)
+        {
+            advance = lanes.clockTrigger[b].process(inputs[CLOCK_INPUT].getPolyVoltageSimd<float_4>(c));
+            gateHigh = lanes.clockTrigger[b].isHigh();
+        }
+        else
+        {
+            lanes.phase[b] += clockStep;
+            advance = lanes.phase[b] >= 1.0f;
+            lanes.phase[b] = simd::ifelse(advance, lanes.phase[b] - 1.0f, lanes.phase[b]);
+            gateHigh = lanes.phase[b] < 0.5f;
+        }
+        float_4 reset = lanes.resetTrigger[b].process(inputs[RESET_INPUT].getPolyVoltageSimd<float_4>(c));
+
+        /** Step changes, handled one lane at a time. */
+        const int resetMask = simd::movemask(reset);
+        const int eventMask = simd::movemask(advance) | resetMask;
+        for (int i = 0; i < 4 && c + i < lanes.numLanes; ++i)
+        {
+            if (!(eventMask & (1 << i)))
+                continue;
+
+            const int regionStart = ((c + i) % numMeasures) * 8;
+            int offset = lanes.step[b].s[i];
+            if (resetMask & (1 << i))
+            {
+                offset = (seqMode == Reverse) ? numStepsPerMeasure - 1 : 0;
+                lanes.phase[b].s[i] = 0.0f;
+            }
+            else
+                offset = advanceLaneStep(offset, regionStart, stepActive);
+
+            lanes.step[b].s[i] = offset;
+            lanes.pitch[b].s[i] = stepPitch(regionStart + offset, octaves, semitones);
+            lanes.gateRand[b].s[i] = random::uniform();
+            lanes.detune[b].s[i] = random::uniform() * 2.0f - 1.0f;
+
+            /** Parameter locks of the lane's new step. */
+            const int step = regionStart + offset;
+            for (int lock = 0; lock < ParamLocks::NUM_LOCKS; ++lock)
+            {
+                bool locked = paramLocks.has(step, lock);
+                lanes.lockedMask[lock][b].s[i] = (locked) ? -1 : 0;
+                if (!locked)
+                    continue;
+
+                float value = paramLocks.get(step, lock);
+                if (lock == ParamLocks::SLIDE)
+                    value = (value > 0.0f) ? 1.0f / (1.0f + value * args.sampleRate) : 0.0f;
+                else if (lock == ParamLocks::DETUNE_AMOUNT)
+                    value /= 12.0f;
+                lanes.lockedValue[lock][b].s[i] = value;
+            }
+        }
+
+        /** Per-sample work, four lanes at a time. */
+        float_4 laneProbability = gateProbability;
+        float_4 laneDetuneAmount = detuneAmount;
+        float_4 laneSlewRate = slewRate;
+        if (anyLocks)
+        {
+            laneProbability = simd::ifelse(float_4::cast(lanes.lockedMask[ParamLocks::GATE_PROBABILITY][b]),
+                                           lanes.lockedValue[ParamLocks::GATE_PROBABILITY][b], laneProbability);
+            laneDetuneAmount = simd::ifelse(float_4::cast(lanes.lockedMask[ParamLocks::DETUNE_AMOUNT][b]),
+                                            lanes.lockedValue[ParamLocks::DETUNE_AMOUNT][b], laneDetuneAmount);
+            laneSlewRate = simd::ifelse(float_4::cast(lanes.lockedMask[ParamLocks::SLIDE][b]),
+                                        lanes.lockedValue[ParamLocks::SLIDE][b], laneSlewRate);
+            if (!externalClock)
+            {
+                float_4 gateLength = simd::ifelse(float_4::cast(lanes.lockedMask[ParamLocks::GATE_LENGTH][b]),
+                                                  lanes.lockedValue[ParamLocks::GATE_LENGTH][b], float_4(0.5f));
+                gateHigh = lanes.phase[b] < gateLength;
+            }
+        }
+
+        float_4 laneGate = gateHigh & (lanes.gateRand[b] < laneProbability);
+        float_4 target = lanes.pitch[b] + simd::ifelse(laneGate, lanes.detune[b] * laneDetuneAmount, float_4(0.0f));
+        if (anyLocks)
+        {
+            float_4 slewed = lanes.slew[b] + simd::fmax(simd::fmin(target - lanes.slew[b], laneSlewRate), -laneSlewRate);
+            lanes.slew[b] = simd::ifelse(laneSlewRate > 0.0f, slewed, target);
+        }
+        else if (slewRate > 0.0f)
+            lanes.slew[b] += simd::fmax(simd::fmin(target - lanes.slew[b], float_4(slewRate)), float_4(-slewRate));
+        else
+            lanes.slew[b] = target;
+
+        outputs[GATE_OUTPUT].setVoltageSimd(simd::ifelse(laneGate, float_4(10.0f), float_4(0.0f)), c);
+        outputs[CV_OUTPUT].setVoltageSimd(lanes.slew[b], c);
+
+        /** The gate light follows the first lane. */
+        if (b == 0)
+            gate = simd::movemask(laneGate) & 1;
+    }
+
+    outputs[GATE_OUTPUT].setChannels(lanes.numLanes);
+    outputs[CV_OUTPUT].setChannels(lanes.numLanes);
+}
+
+/**
+ * Publishes the pattern and playhead for the overview display, if they have \n
+ * changed since the last time.
+ *
+ * @param playhead is the index of the playing step in the 32 step arrays.
+ */
+void SemitoneSequencer::publishSnapshot(const float *octaves, const float *semitones, const float *stepActive, int playhead)
+{
+    PatternSnapshot snapshot;
+    snapshot.pattern.fromArrays(octaves, semitones, stepActive);
+    snapshot.pattern.numStepsPerMeasure = numStepsPerMeasure;
+    snapshot.pattern.numMeasures = numMeasures;
+    snapshot.step = playhead;
+    snapshot.running = running;
+    snapshot.reserved[0] = snapshot.reserved[1] = 0;
+
+    if (std::memcmp(&snapshot, &publishedSnapshot, sizeof(snapshot)) == 0)
+        return;
+    publishedSnapshot = snapshot;
+    patternSnapshot.publish(snapshot);
+}
+
+/**
+ * Sends the step, clock phase, CV, gate and scale to an adjacent module on the \n
+ * expander bus, if there is one to the right. In audio rate mode the clock \n
+ * phase is the first channel's position in the pattern.
+ */
+void SemitoneSequencer::sendExpanderMessage()
+{
+    ExpanderMessage *message = ExpanderBus::beginSend(this);
+    if (!message)
+        return;
+
+    message->stepCount = stepCount;
+    message->step = stepNumber;
+    if (audioRate)
+        message->clockPhase = audioRatePhase[0].s[0] / audioRateLength;
+    else
+        message->clockPhase = (inputs[CLOCK_INPUT].isConnected())
+                                  ? ((clockPeriod > 0) ? std::fmin(static_cast<float>(samplesSinceClock) / clockPeriod, 1.0f) : 0.0f)
+                                  : phase;
+
+    message->channels = std::max(outputs[CV_OUTPUT].getChannels(), 1);
+    for (int c = 0; c < message->channels; ++c)
+    {
+        message->cv[c] = outputs[CV_OUTPUT].getVoltage(c);
+        message->gate[c] = outputs[GATE_OUTPUT].getVoltage(std::min(c, std::max(outputs[GATE_OUTPUT].getChannels(), 1) - 1));
+    }
+
+    /** The guide set is the quantization scale, in the same order as the quantization modes. */
+    static const int scales[2][7] = {{0, 2, 3, 5, 7, 8, 10}, {0, 2, 4, 5, 7, 9, 11}};
+    message->chordMode = chordMode;
+    message->numGuideNotes = 0;
+    if (quantizationMode > 0)
+    {
+        for (int i = 0; i < 7; ++i)
+            message->guideNotes[i] = scales[quantizationMode - 1][i] / 12.0f;
+        message->numGuideNotes = 7;
+    }
+
+    ExpanderBus::send(this);
+}
+
+/**
+ * Writes the knobs of the selected measure back into the pattern, unless a \n
+ * library pattern is playing, and bakes every active step into the audio rate \n
+ * table. Called every AUDIO_RATE_DIVISION samples.
+ */
+void SemitoneSequencer::updateAudioRateTable()
+{
+    float octaves[32];
+    float semitones[32];
+    float stepActive[32];
+    const PatternLibrary *library = activePatternLibrary.load(std::memory_order_acquire);
+    if (library && inputs[PATTERN_SELECT_INPUT].isConnected())
+        library->select(inputs[PATTERN_SELECT_INPUT].getVoltage())->toArrays(octaves, semitones, stepActive);
+    else
+    {
+        int measure = (int)params[MEASURE_SWITCH_PARAM].getValue();
+        for (int step = 0; step < 8; ++step)
+        {
+            params[FAKE_OCT_PARAM + step + measure * 8].setValue(params[OCT1_PARAM + step].getValue());
+            params[FAKE_SEMITONE_PARAM + step + measure * 8].setValue(params[SEMITONE1_PARAM + step].getValue());
+            params[FAKE_STEP_ACTIVE_PARAM + step + measure * 8].setValue(params[STEP1_ACTIVE_PARAM + step].getValue());
+        }
+        for (int i = 0; i < 32; ++i)
+        {
+            octaves[i] = params[FAKE_OCT_PARAM + i].getValue();
+            semitones[i] = params[FAKE_SEMITONE_PARAM + i].getValue();
+            stepActive[i] = params[FAKE_STEP_ACTIVE_PARAM + i].getValue();
+        }
+    }
+
+    int length = 0;
+    for (int measure = 0; measure < numMeasures; ++measure)
+    {
+        for (int step = 0; step < numStepsPerMeasure; ++step)
+        {
+            int index = measure * 8 + step;
+            if (stepActive[index])
+                audioRateTable[++length] = stepPitch(index, octaves, semitones);
+        }
+    }
+    if (length == 0)
+        audioRateTable[++length] = 0.0f;
+
+    audioRateTable[0] = audioRateTable[length];
+    audioRateTable[length + 1] = audioRateTable[1];
+    audioRateLength = length;
+}
+
+/**
+ * Plays the pattern as an oscillator, always forwards, one channel per channel \n
+ * of the clock input. The clock input is V/Oct, and with the clock knob at its \n
+ * default 0V steps at C4. The gate output is a square at the pattern frequency. \n
+ * With band limiting on, each step edge gets a PolyBLEP correction, as long as \n
+ * a step lasts at least two samples.
+ */
+void SemitoneSequencer::processAudioRate(const ProcessArgs &args)
+{
+    using simd::float_4;
+
+    if (audioRateDivider.process())
+    {
+        updateAudioRateTable();
+        lights[RUNNING_LIGHT].setBrightness(1.0f);
+        lights[GATE_LIGHT].setBrightness(0.0f);
+    }
+
+    const int channels = std::max(inputs[CLOCK_INPUT].getChannels(), 1);
+    const float length = audioRateLength;
+    const float pitch = params[CLOCK_PARAM].getValue() - 2.0f;
+    const float baseIncrement = dsp::FREQ_C4 * args.sampleTime;
+
+    for (int c = 0; c < channels; c += 4)
+    {
+        float_4 &phase = audioRatePhase[c / 4];
+        float_4 increment = baseIncrement * TAR::Math::fastExp2(pitch + inputs[CLOCK_INPUT].getPolyVoltageSimd<float_4>(c));
+        increment = simd::fmin(increment, float_4(length));
+        phase += increment;
+        /** Wraps from any distance past the end, as the table may just have shrunk. */
+        phase -= length * simd::floor(phase / length);
+        phase = simd::ifelse(phase >= length, float_4(0.0f), phase);
+
+        float_4 previous, current, next;
+        for (int i = 0; i < 4; ++i)
+        {
+            int index = static_cast<int>(phase.s[i]);
+            previous.s[i] = audioRateTable[index];
+            current.s[i] = audioRateTable[index + 1];
+            next.s[i] = audioRateTable[index + 2];
+        }
+
+        float_4 out = current;
+        if (audioRateBandLimit)
+        {
+            float_4 t = phase - simd::floor(phase);
+            float_4 dt = simd::fmin(increment, float_4(0.5f));
+            float_4 x = t / dt;
+            float_4 y = (t - 1.0f) / dt;
+            float_4 after = simd::ifelse(t < dt, 2.0f * x - x * x - 1.0f, float_4(0.0f));
+            float_4 before = simd::ifelse(t > 1.0f - dt, y * y + 2.0f * y + 1.0f, float_4(0.0f));
+            out += 0.5f * ((current - previous) * after + (next - current) * before);
+        }
+
+        outputs[CV_OUTPUT].setVoltageSimd(out, c);
+        outputs[GATE_OUTPUT].setVoltageSimd(simd::ifelse(phase < 0.5f * length, float_4(10.0f), float_4(0.0f)), c);
+    }
+    outputs[CV_OUTPUT].setChannels(channels);
+    outputs[GATE_OUTPUT].setChannels(channels);
+
+    /** The neighbour follows the table output, so it never holds a stale message. */
+    sendExpanderMessage();
 }
 
 /** ... */
 void SemitoneSequencer::process(const ProcessArgs &args)
 {
+    if (!commands.empty())
+        applyCommands();
+
+    if (audioRate)
+    {
+        processAudioRate(args);
+        return;
+    }
+
     seqMode = SequencerMode(params[MODE_SWITCH_PARAM].getValue());
-    randLFOValue = random::uniform();
+    ++sampleCounter;
 
     /**
      * Calculates the measure number based on the step number and number of \n
@@ -300,9 +1176,18 @@ void SemitoneSequencer::process(const ProcessArgs &args)
     else
         changedMeasureNumberPulse.reset();
 
+    /**
+     * With a library loaded and the pattern select input connected, the pattern is \n
+     * read straight out of the library, and knob edits are not written back.
+     */
+    const PatternLibrary *library = activePatternLibrary.load(std::memory_order_acquire);
+    const PatternRecord *libraryPattern = (library && inputs[PATTERN_SELECT_INPUT].isConnected())
+                                              ? library->select(inputs[PATTERN_SELECT_INPUT].getVoltage())
+                                              : nullptr;
+
     int measureValueToUse = (running) ? measureNumber : measureSwitch;
     bool writeOn = changedMeasureNumberPulse.process(args.sampleTime) || !running;
-    if (writeOn && lastMeasureSwitch == measureSwitch)
+    if (writeOn && lastMeasureSwitch == measureSwitch && !libraryPattern)
     {
         for (int step = 0; step < 8; ++step)
         {
@@ -326,10 +1211,28 @@ void SemitoneSequencer::process(const ProcessArgs &args)
         fakeStepActiveParamValues[i] = params[FAKE_STEP_ACTIVE_PARAM + i].getValue();
     }
 
+    if (libraryPattern)
+    {
+        libraryPattern->toArrays(fakeOctParamValues, fakeSemitoneParamValues, fakeStepActiveParamValues);
+        if (libraryPattern->numStepsPerMeasure)
+            numStepsPerMeasure = clamp((int)libraryPattern->numStepsPerMeasure, 1, 8);
+        if (libraryPattern->numMeasures)
+            numMeasures = clamp((int)libraryPattern->numMeasures, 1, 4);
+    }
+
     /** Turn running on and off when the running button is pressed. */
     if (runningTrigger.process(params[RUNNING_PARAM].getValue()))
         running = !running;
 
+    /** A polyphonic clock or reset cable splits the sequencer into lanes. */
+    int numLanes = std::max(inputs[CLOCK_INPUT].getChannels(), inputs[RESET_INPUT].getChannels());
+    bool laneMode = numLanes > 1;
+    if (numLanes != lanes.numLanes)
+    {
+        lanes.reset();
+        lanes.numLanes = numLanes;
+    }
+
     /**  */
     if (running)
     {
@@ -343,74 +1246,86 @@ void SemitoneSequencer::process(const ProcessArgs &args)
                 fakeStepActiveParamValues[step + measureNumber * 8]);
         }
 
+        /** Independent lanes */
+        if (laneMode)
+        {
+            processLanes(args, fakeOctParamValues, fakeSemitoneParamValues, fakeStepActiveParamValues);
+        }
         /** External clock */
-        if (inputs[CLOCK_INPUT].isConnected())
+        else if (inputs[CLOCK_INPUT].isConnected())
         {
-            if (trigger.process(inputs[CLOCK_INPUT].getVoltage()))
+            bool clockEdge = trigger.process(inputs[CLOCK_INPUT].getVoltage());
+            updateGrooveTable(args.sampleRate);
+
+            ++samplesSinceClock;
+            ++stepSample;
+            if (clockEdge)
+            {
+                clockPeriod = samplesSinceClock;
+                samplesSinceClock = 0;
+            }
+
+            if (!grooveActive)
             {
                 /**
-                 * Pass to the setStep function the current step number plus 1 \n
-                 * if the mode is forward or random, and pass it the step number \n
-                 * minus 1 if it is reverse.
+                 * The gate follows the clock, unless the step has a gate length \n
+                 * lock or ratchets, which are scheduled against the measured period.
                  */
-                if (seqMode == Forward || seqMode == Random)
+                if (clockEdge)
                 {
-                    while (!(fakeStepActiveParamValues[stepNumber + numStepsToIncrement]))
-                        ++numStepsToIncrement;
+                    advanceStep(fakeStepActiveParamValues);
+                    glide.beginStep(clockPeriod, legato);
+                    gateFollowsClock = !(activeLocks & (1 << ParamLocks::GATE_LENGTH)) && stepRatchets[patternStep(stepNumber)] <= 1;
+                    if (!gateFollowsClock)
+                        scheduleGates(clockPeriod, static_cast<int>(lockedOr(ParamLocks::GATE_LENGTH, 0.5f) * clockPeriod));
+                }
 
-                    setStep(stepNumber + 1, seqMode);
-                    numStepsToIncrement = 1;
+                gate = (gateFollowsClock) ? trigger.isHigh() : gateScheduler.process(sampleCounter);
+            }
+            else
+            {
+                /**
+                 * The groove delays each step by a fraction of the measured clock \n
+                 * period, and sets its gate length the same way.
+                 */
+                if (clockEdge)
+                {
+                    stepDelay = static_cast<int>(grooveTable.delay[grooveStep] * clockPeriod);
+                    stepPending = true;
                 }
-                else
+                if (stepPending && samplesSinceClock >= stepDelay)
                 {
-                    while (!(fakeStepActiveParamValues[stepNumber - numStepsToIncrement]))
-                        ++numStepsToIncrement;
-
-                    setStep(stepNumber - 1, seqMode);
-                    numStepsToIncrement = 1;
+                    stepPending = false;
+                    float gateLength = grooveTable.gateLength[grooveStep];
+                    grooveStep = (grooveStep + 1) % grooveTable.length;
+                    advanceStep(fakeStepActiveParamValues);
+                    glide.beginStep(clockPeriod, legato);
+                    scheduleGates(clockPeriod, static_cast<int>(lockedOr(ParamLocks::GATE_LENGTH, gateLength) * clockPeriod));
                 }
 
-                randValue = random::uniform();
-                resetRandLFO();
+                gate = gateScheduler.process(sampleCounter);
             }
-
-            /** Sets the gate according to the clock trigger */
-            gate = trigger.isHigh();
         }
         /** Internal clock */
         else
         {
-            if (params[SWING_PARAM].getValue() > 1.0f)
-            {
-                swingTrigger.process(!(stepNumber % 2));
-            }
-            float swingMultiplier = (swingTrigger.state) ? params[SWING_PARAM].getValue() : 1;
-            float clockTime = std::pow(2.f, params[CLOCK_PARAM].getValue() * swingMultiplier) / (params[SWING_PARAM].getValue());
-            phase += clockTime * args.sampleTime;
-            if (phase >= 1.f)
-            {
-                if (seqMode == Forward || seqMode == Random)
-                {
-                    while (!(fakeStepActiveParamValues[stepNumber + numStepsToIncrement]))
-                        ++numStepsToIncrement;
-
-                    setStep(stepNumber + 1, seqMode);
-                    numStepsToIncrement = 1;
-                }
-                else
-                {
-                    while (!(fakeStepActiveParamValues[stepNumber - numStepsToIncrement]))
-                        ++numStepsToIncrement;
+            updateGrooveTable(args.sampleRate);
 
-                    setStep(stepNumber - numStepsToIncrement, seqMode);
-                    numStepsToIncrement = 1;
-                }
-                randValue = random::uniform();
-                resetRandLFO();
+            phase += stepPhaseIncrement;
+            if (++stepSample >= grooveTable.stepSamples[grooveStep])
+            {
+                grooveStep = (grooveStep + 1) % grooveTable.length;
+                stepPhaseIncrement = 1.0f / grooveTable.stepSamples[grooveStep];
+                advanceStep(fakeStepActiveParamValues);
+                glide.beginStep(grooveTable.stepSamples[grooveStep], legato);
+                stepGateSamples = (activeLocks & (1 << ParamLocks::GATE_LENGTH))
+                                      ? static_cast<int>(lockedValues[ParamLocks::GATE_LENGTH] * grooveTable.stepSamples[grooveStep])
+                                      : grooveTable.gateSamples[grooveStep];
+                scheduleGates(grooveTable.stepSamples[grooveStep], stepGateSamples);
             }
 
-            /** Sets the gate according to the phase */
-            gate = (phase < 0.5f);
+            /** Sets the gate according to the groove and ratchets */
+            gate = gateScheduler.process(sampleCounter);
         }
     }
     else
@@ -426,16 +1341,24 @@ void SemitoneSequencer::process(const ProcessArgs &args)
         }
     }
 
-    /** Sets the gate output. */
+    /** Sets the gate output. Lanes set their own gates. */
     bool randomizedGate = false;
-    if (params[GATE_PROBABILITY_PARAM].getValue() > 0.0f)
-        randomizedGate = gate && (randValue < params[GATE_PROBABILITY_PARAM].getValue());
-    outputs[GATE_OUTPUT].setVoltage((randomizedGate) ? 10.0f : 0.0f);
+    if (laneMode)
+        randomizedGate = running && gate;
+    else
+    {
+        float gateProbability = lockedOr(ParamLocks::GATE_PROBABILITY, params[GATE_PROBABILITY_PARAM].getValue());
+        if (gateProbability > 0.0f)
+            randomizedGate = gate && (randValue < gateProbability);
+        outputs[GATE_OUTPUT].setChannels(1);
+        outputs[GATE_OUTPUT].setVoltage((randomizedGate) ? 10.0f : 0.0f);
+    }
 
     /** Takes care of variables responsible for pitch slidng. */
-    float riseAndFall = params[SLIDE_PARAM].getValue();
-    for (int i = 0; i < 4; ++i)
-        slew[i].setVars(riseAndFall);
+    float riseAndFall = lockedOr(ParamLocks::SLIDE, params[SLIDE_PARAM].getValue());
+    float detuneAmountValue = lockedOr(ParamLocks::DETUNE_AMOUNT, params[DETUNE_AMOUNT_PARAM].getValue());
+    slew.setTimes(riseAndFall, riseAndFall, args.sampleTime);
+    glide.setTime(riseAndFall, args.sampleTime);
 
     /** ... */
     int outputIndex = stepNumber + (measureNumber * (8 - numStepsPerMeasure));
@@ -448,20 +1371,35 @@ void SemitoneSequencer::process(const ProcessArgs &args)
     float LFOPitchAtten = params[SWING_PARAM].getValue();
 
     float monoOrPolyMeasureIndex = (chordMode == 0) ? 1 : numMeasures;
+
+    /** The LFOs of all four voices advance together. */
+    simd::float_4 sineLFOValues = 0.f;
+    simd::float_4 randomLFOValues = 0.f;
+    if (running && !laneMode && detuneAmountValue > 0 && detuneMode == LFO)
+    {
+        sineLFO.setRate(params[CLOCK_PARAM].getValue(), LFOPitchAtten, args.sampleTime, lfoDecorrelation);
+        sineLFOValues = sineLFO.process();
+    }
+    else if (running && !laneMode && detuneAmountValue > 0 && detuneMode == RANDOM_LFO)
+    {
+        randomLFO.setRate(params[CLOCK_PARAM].getValue(), LFOPitchAtten, args.sampleTime, lfoDecorrelation);
+        randomLFOValues = randomLFO.process();
+    }
+
     /**
      * Sets the CV output, first for the normal monophonic mode, and then for the \n
      * chords mode.
      */
-    if (running)
+    if (running && !laneMode)
     {
         float rawPitch = 0.0f;
         float preSlewCV[4] = {};
-        float outputCV[4] = {};
+        float detuneCV[4] = {};
         /** Iterates through the channels / chord voices. */
         for (int c = 0; c < monoOrPolyMeasureIndex; ++c)
         {
             float detuneAmount[4] = {};
-            if (params[DETUNE_AMOUNT_PARAM].getValue() > 0)
+            if (detuneAmountValue > 0)
             {
                 switch (detuneMode)
                 {
@@ -469,17 +1407,15 @@ void SemitoneSequencer::process(const ProcessArgs &args)
                     detuneAmount[c] = lfo[c].randomSquareLFO(gate);
                     break;
                 case LFO:
-                    detuneAmount[c] = lfo[c].sineLFO(
-                        params[CLOCK_PARAM].getValue(), args.sampleTime, LFOPitchAtten);
+                    detuneAmount[c] = sineLFOValues.s[c];
                     break;
                 case RANDOM_LFO:
-                    detuneAmount[c] = lfo[c].randomSmoothLFO(
-                        randLFOValue, randLFOLastValue, phase);
+                    detuneAmount[c] = randomLFOValues.s[c];
                     break;
                 default:
                     detuneAmount[c] = 0.0f;
                 }
-                detuneAmount[c] *= params[DETUNE_AMOUNT_PARAM].getValue();
+                detuneAmount[c] *= detuneAmountValue;
             }
             else
                 detuneAmount[c] = 0.0f;
@@ -490,21 +1426,26 @@ void SemitoneSequencer::process(const ProcessArgs &args)
                 (fakeSemitoneParamValues[outputIndex] / 12.0f);
 
             if (quantizationMode == 0)
-                preSlewCV[c] = rawPitch + detuneAmount[chordMode * c] / 12.0f;
+                preSlewCV[c] = rawPitch;
             else
             {
                 quantizer.semitoneRound(rawPitch);
-                preSlewCV[c] = quantizer.setOutputVoltage() + detuneAmount[chordMode * c] / 12.0f;
+                preSlewCV[c] = quantizer.setOutputVoltage();
             }
-
-            if (params[SLIDE_PARAM].getValue() <= 0.0f)
-                outputCV[c] = preSlewCV[c];
-            else
-                outputCV[c] = slew[c].process(preSlewCV[c], args.sampleRate);
-
-            outputs[CV_OUTPUT].setChannels((chordMode > 0) ? numMeasures : 1);
-            outputs[CV_OUTPUT].setVoltage(outputCV[c], c);
+            detuneCV[c] = detuneAmount[chordMode * c] / 12.0f;
         }
+
+        /**
+         * All four voices slide together. The slew limiter follows the detuned \n
+         * pitch, while a glide only moves between notes and the detune rides on top.
+         */
+        simd::float_4 outputCV;
+        if (slideMode == SLIDE_SLEW)
+            outputCV = slew.process(simd::float_4::load(preSlewCV) + simd::float_4::load(detuneCV));
+        else
+            outputCV = glide.process(simd::float_4::load(preSlewCV)) + simd::float_4::load(detuneCV);
+        outputs[CV_OUTPUT].setChannels((chordMode > 0) ? numMeasures : 1);
+        outputs[CV_OUTPUT].setVoltageSimd(outputCV, 0);
     }
 
     /** Handles a reset call, either via the reset input or the reset button. */
@@ -522,6 +1463,14 @@ void SemitoneSequencer::process(const ProcessArgs &args)
             measureNumber = numMeasures - 1;
             params[MEASURE_SWITCH_PARAM].setValue(static_cast<float>(numMeasures - 1));
         }
+
+        /** Restarts the groove cycle, and drops the old step's pending step and gates. */
+        grooveStep = 0;
+        stepSample = 0;
+        stepPending = false;
+        stepPhaseIncrement = 1.0f / grooveTable.stepSamples[0];
+        gateScheduler.reset();
+        resolveLocks(patternStep(stepNumber));
     }
 
     /** These if statements are for writing the measure lights. */
@@ -591,6 +1540,11 @@ void SemitoneSequencer::process(const ProcessArgs &args)
 
     /* Resets the variables that track whether a param is changed. */
     lastMeasureSwitch = measureSwitch;
+
+    if (snapshotDivider.process())
+        publishSnapshot(fakeOctParamValues, fakeSemitoneParamValues, fakeStepActiveParamValues,
+                        stepNumber + measureNumber * (8 - numStepsPerMeasure));
+    sendExpanderMessage();
 }
 //};
 
@@ -611,6 +1565,271 @@ void SemitoneSequencer::process(const ProcessArgs &args)
     //rack::math::Rect boundingBox = rack::math::Rect((rack::math::Vec)position, size);
 }; */
 
+/**
+ * A context menu slider for one value of a user groove, either a step's timing
+ * offset or its gate length.
+ */
+struct GrooveValueQuantity : Quantity
+{
+    SemitoneSequencer *module;
+    int groove;
+    int step;
+    bool isGateLength;
+
+    float value()
+    {
+        const GrooveTemplate &userGroove = module->userGrooves[groove];
+        return (isGateLength) ? userGroove.gateLength[step] : userGroove.offset[step];
+    }
+
+    void setValue(float v) override
+    {
+        module->sendCommand((isGateLength) ? SequencerCommand::SET_USER_GROOVE_GATE_LENGTH : SequencerCommand::SET_USER_GROOVE_OFFSET,
+                            groove, step, clamp(v, getMinValue(), getMaxValue()));
+    }
+    float getValue() override { return value(); }
+    float getMinValue() override { return (isGateLength) ? 0.0f : GrooveTemplate::MIN_OFFSET; }
+    float getMaxValue() override { return (isGateLength) ? 1.0f : GrooveTemplate::MAX_OFFSET; }
+    float getDefaultValue() override { return (isGateLength) ? 0.5f : 0.0f; }
+    float getDisplayValue() override { return getValue() * 100.0f; }
+    void setDisplayValue(float displayValue) override { setValue(displayValue / 100.0f); }
+    std::string getUnit() override { return "%"; }
+    std::string getLabel() override
+    {
+        return "Step " + std::to_string(step + 1) + ((isGateLength) ? " gate" : " offset");
+    }
+};
+
+struct GrooveValueSlider : ui::Slider
+{
+    GrooveValueSlider(SemitoneSequencer *module, int groove, int step, bool isGateLength)
+    {
+        GrooveValueQuantity *q = new GrooveValueQuantity;
+        q->module = module;
+        q->groove = groove;
+        q->step = step;
+        q->isGateLength = isGateLength;
+        quantity = q;
+        box.size.x = 200.0f;
+    }
+    ~GrooveValueSlider() { delete quantity; }
+};
+
+/** Fills the editing submenu of one user groove. */
+void appendUserGrooveMenu(Menu *menu, SemitoneSequencer *module, int groove)
+{
+    struct GrooveLengthItem : MenuItem
+    {
+        SemitoneSequencer *module;
+        int groove;
+        int length;
+        void onAction(const event::Action &e) override
+        {
+            module->sendCommand(SequencerCommand::SET_USER_GROOVE_LENGTH, groove, length);
+        }
+    };
+
+    menu->addChild(createMenuLabel("Length"));
+    for (int length = 1; length <= GrooveTemplate::MAX_STEPS; length *= 2)
+    {
+        GrooveLengthItem *lItem = createMenuItem<GrooveLengthItem>(std::to_string(length) + " steps");
+        lItem->rightText = CHECKMARK(module->userGrooves[groove].length == length);
+        lItem->module = module;
+        lItem->groove = groove;
+        lItem->length = length;
+        menu->addChild(lItem);
+    }
+
+    menu->addChild(new MenuEntry);
+    for (int step = 0; step < module->userGrooves[groove].length; ++step)
+    {
+        menu->addChild(new GrooveValueSlider(module, groove, step, false));
+        menu->addChild(new GrooveValueSlider(module, groove, step, true));
+    }
+}
+
+/** A context menu slider for one parameter lock of one step. */
+struct ParamLockQuantity : Quantity
+{
+    SemitoneSequencer *module;
+    int step;
+    int lock;
+
+    void setValue(float v) override
+    {
+        module->sendCommand(SequencerCommand::SET_PARAM_LOCK, step, lock, clamp(v, getMinValue(), getMaxValue()));
+    }
+    float getValue() override
+    {
+        return (module->paramLocks.has(step, lock)) ? module->paramLocks.get(step, lock) : getDefaultValue();
+    }
+    float getDefaultValue() override
+    {
+        switch (lock)
+        {
+        case ParamLocks::SLIDE:
+            return module->params[SemitoneSequencer::SLIDE_PARAM].getValue();
+        case ParamLocks::DETUNE_AMOUNT:
+            return module->params[SemitoneSequencer::DETUNE_AMOUNT_PARAM].getValue();
+        case ParamLocks::GATE_PROBABILITY:
+            return module->params[SemitoneSequencer::GATE_PROBABILITY_PARAM].getValue();
+        default:
+            return 0.5f;
+        }
+    }
+    float getDisplayValue() override { return getValue() * 100.0f; }
+    void setDisplayValue(float displayValue) override { setValue(displayValue / 100.0f); }
+    std::string getUnit() override { return (lock == ParamLocks::DETUNE_AMOUNT) ? " cents" : "%"; }
+    std::string getLabel() override
+    {
+        static const char *lockNames[ParamLocks::NUM_LOCKS] = {"Slide", "Detune", "Gate probability", "Gate length"};
+        return std::string(lockNames[lock]) + ((module->paramLocks.has(step, lock)) ? " (locked)" : "");
+    }
+};
+
+struct ParamLockSlider : ui::Slider
+{
+    ParamLockSlider(SemitoneSequencer *module, int step, int lock)
+    {
+        ParamLockQuantity *q = new ParamLockQuantity;
+        q->module = module;
+        q->step = step;
+        q->lock = lock;
+        quantity = q;
+        box.size.x = 200.0f;
+    }
+    ~ParamLockSlider() { delete quantity; }
+};
+
+/** Fills the parameter lock submenu of one step. Moving a slider locks it. */
+void appendParamLockMenu(Menu *menu, SemitoneSequencer *module, int step)
+{
+    struct ClearLockItem : MenuItem
+    {
+        SemitoneSequencer *module;
+        int step;
+        int lock;
+        void onAction(const event::Action &e) override
+        {
+            module->sendCommand(SequencerCommand::CLEAR_PARAM_LOCK, step, lock);
+        }
+    };
+
+    static const char *clearNames[ParamLocks::NUM_LOCKS] = {
+        "Clear slide lock", "Clear detune lock", "Clear gate probability lock", "Clear gate length lock"};
+    for (int lock = 0; lock < ParamLocks::NUM_LOCKS; ++lock)
+        menu->addChild(new ParamLockSlider(module, step, lock));
+
+    menu->addChild(new MenuEntry);
+    for (int lock = -1; lock < ParamLocks::NUM_LOCKS; ++lock)
+    {
+        if (lock >= 0 && !module->paramLocks.has(step, lock))
+            continue;
+        ClearLockItem *cItem = createMenuItem<ClearLockItem>((lock < 0) ? "Clear all locks" : clearNames[lock]);
+        cItem->module = module;
+        cItem->step = step;
+        cItem->lock = lock;
+        menu->addChild(cItem);
+    }
+}
+
+/**
+ * A context menu slider for a module setting that has no panel control. It \n
+ * reads the setting directly and changes it by sending a command.
+ */
+struct SettingQuantity : Quantity
+{
+    SemitoneSequencer *module;
+    SequencerCommand::Type command;
+    const float *setting;
+    std::string label;
+    float minValue = 0.0f;
+    float maxValue = 1.0f;
+    float defaultValue = 0.0f;
+    float displayMultiplier = 100.0f;
+    std::string unit = "%";
+
+    void setValue(float v) override { module->sendCommand(command, 0, 0, clamp(v, minValue, maxValue)); }
+    float getValue() override { return *setting; }
+    float getMinValue() override { return minValue; }
+    float getMaxValue() override { return maxValue; }
+    float getDefaultValue() override { return defaultValue; }
+    float getDisplayValue() override { return getValue() * displayMultiplier; }
+    void setDisplayValue(float displayValue) override { setValue(displayValue / displayMultiplier); }
+    std::string getUnit() override { return unit; }
+    std::string getLabel() override { return label; }
+};
+
+struct SettingSlider : ui::Slider
+{
+    SettingSlider(SettingQuantity *q)
+    {
+        quantity = q;
+        box.size.x = 200.0f;
+    }
+    ~SettingSlider() { delete quantity; }
+};
+
+/** Makes a slider for a 0 - 100% setting. */
+SettingSlider *createSettingSlider(SemitoneSequencer *module, SequencerCommand::Type command,
+                                   const float *setting, std::string label)
+{
+    SettingQuantity *q = new SettingQuantity;
+    q->module = module;
+    q->command = command;
+    q->setting = setting;
+    q->label = label;
+    return new SettingSlider(q);
+}
+
+/** Fills the ratchet submenu of one step: the retrigger count and the spacing curve. */
+void appendRatchetMenu(Menu *menu, SemitoneSequencer *module, int step)
+{
+    struct RatchetCountItem : MenuItem
+    {
+        SemitoneSequencer *module;
+        int step;
+        int count;
+        void onAction(const event::Action &e) override
+        {
+            module->sendCommand(SequencerCommand::SET_RATCHETS, step, count);
+        }
+    };
+
+    struct RatchetCurveItem : MenuItem
+    {
+        SemitoneSequencer *module;
+        int step;
+        int curve;
+        void onAction(const event::Action &e) override
+        {
+            module->sendCommand(SequencerCommand::SET_RATCHET_CURVE, step, curve);
+        }
+    };
+
+    for (int count = 1; count <= SemitoneSequencer::MAX_RATCHETS; ++count)
+    {
+        RatchetCountItem *rItem = createMenuItem<RatchetCountItem>((count == 1) ? "Off" : std::to_string(count) + " triggers");
+        rItem->rightText = CHECKMARK(module->stepRatchets[step] == count);
+        rItem->module = module;
+        rItem->step = step;
+        rItem->count = count;
+        menu->addChild(rItem);
+    }
+
+    menu->addChild(new MenuEntry);
+    menu->addChild(createMenuLabel("Spacing"));
+    for (int curve = 0; curve < NUM_RATCHET_CURVES; ++curve)
+    {
+        RatchetCurveItem *cItem = createMenuItem<RatchetCurveItem>(RATCHET_CURVE_NAMES[curve]);
+        cItem->rightText = CHECKMARK(module->stepRatchetCurves[step] == curve);
+        cItem->module = module;
+        cItem->step = step;
+        cItem->curve = curve;
+        menu->addChild(cItem);
+    }
+}
+
 /**
  * @struct SemitoneSequencerWidget
  * @brief Manages the module.
@@ -634,7 +1853,7 @@ struct SemitoneSequencerWidget : ModuleWidget
             int mode;
             void onAction(const event::Action &e) override
             {
-                module->numStepsPerMeasure = mode + 1;
+                module->sendCommand(SequencerCommand::SET_STEPS_PER_MEASURE, mode + 1);
             }
         };
 
@@ -657,7 +1876,7 @@ struct SemitoneSequencerWidget : ModuleWidget
             int measures;
             void onAction(const event::Action &e) override
             {
-                module->numMeasures = measures + 1;
+                module->sendCommand(SequencerCommand::SET_NUM_MEASURES, measures + 1);
             }
         };
 
@@ -680,7 +1899,7 @@ struct SemitoneSequencerWidget : ModuleWidget
             int chordMode;
             void onAction(const event::Action &e) override
             {
-                module->chordMode = chordMode;
+                module->sendCommand(SequencerCommand::SET_CHORD_MODE, chordMode);
             }
         };
 
@@ -703,7 +1922,7 @@ struct SemitoneSequencerWidget : ModuleWidget
             int detuneMode;
             void onAction(const event::Action &e) override
             {
-                module->detuneMode = detuneMode;
+                module->sendCommand(SequencerCommand::SET_DETUNE_MODE, detuneMode);
             }
         };
 
@@ -716,6 +1935,86 @@ struct SemitoneSequencerWidget : ModuleWidget
             dItem->detuneMode = i;
             menu->addChild(dItem);
         }
+        menu->addChild(createSettingSlider(module, SequencerCommand::SET_LFO_SPREAD, &module->lfoSpread, "LFO phase spread"));
+        menu->addChild(createSettingSlider(module, SequencerCommand::SET_LFO_DECORRELATION, &module->lfoDecorrelation, "LFO decorrelation"));
+
+        struct RandomKernelItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            int kernel;
+            void onAction(const event::Action &e) override
+            {
+                module->sendCommand(SequencerCommand::SET_RANDOM_KERNEL, kernel);
+            }
+        };
+
+        menu->addChild(createSubmenuItem("Random LFO shape", RIGHT_ARROW, [=](Menu *submenu)
+                                         {
+            std::string kernelNames[SmoothRandomBank::NUM_KERNELS] = {"Linear", "Cosine", "Cubic Hermite", "Band-limited"};
+            for (int i = 0; i < SmoothRandomBank::NUM_KERNELS; ++i)
+            {
+                RandomKernelItem *kItem = createMenuItem<RandomKernelItem>(kernelNames[i]);
+                kItem->rightText = CHECKMARK(module->randomLFO.getKernel() == i);
+                kItem->module = module;
+                kItem->kernel = i;
+                submenu->addChild(kItem);
+            } }));
+
+        struct SlideCurveItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            int curve;
+            void onAction(const event::Action &e) override
+            {
+                module->sendCommand(SequencerCommand::SET_SLIDE_CURVE, curve);
+            }
+        };
+
+        menu->addChild(createSubmenuItem("Slide curve", RIGHT_ARROW, [=](Menu *submenu)
+                                         {
+            std::string curveNames[TSlewLimiter<simd::float_4>::NUM_CURVES] = {"Linear", "Logarithmic", "Exponential", "Classic"};
+            for (int i = 0; i < TSlewLimiter<simd::float_4>::NUM_CURVES; ++i)
+            {
+                SlideCurveItem *cItem = createMenuItem<SlideCurveItem>(curveNames[i]);
+                cItem->rightText = CHECKMARK(module->slew.getCurve() == i);
+                cItem->module = module;
+                cItem->curve = i;
+                submenu->addChild(cItem);
+            } }));
+
+        struct SlideModeItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            int mode;
+            void onAction(const event::Action &e) override
+            {
+                module->sendCommand(SequencerCommand::SET_SLIDE_MODE, mode);
+            }
+        };
+
+        menu->addChild(createSubmenuItem("Slide mode", RIGHT_ARROW, [=](Menu *submenu)
+                                         {
+            std::string modeNames[SemitoneSequencer::NUM_SLIDE_MODES] = {"Slew", "Glide, constant time", "Glide, constant rate"};
+            for (int i = 0; i < SemitoneSequencer::NUM_SLIDE_MODES; ++i)
+            {
+                SlideModeItem *mItem = createMenuItem<SlideModeItem>(modeNames[i]);
+                mItem->rightText = CHECKMARK(module->slideMode == i);
+                mItem->module = module;
+                mItem->mode = i;
+                submenu->addChild(mItem);
+            } }));
+        menu->addChild(createBoolMenuItem(
+            "Sync glide to step length", "",
+            [=]()
+            { return module->glide.getSync(); },
+            [=](bool sync)
+            { module->sendCommand(SequencerCommand::SET_GLIDE_SYNC, sync); }));
+        menu->addChild(createBoolMenuItem(
+            "Glide between adjacent steps only", "",
+            [=]()
+            { return module->glide.getLegatoOnly(); },
+            [=](bool legatoOnly)
+            { module->sendCommand(SequencerCommand::SET_GLIDE_LEGATO, legatoOnly); }));
 
         /** Quantization mode */
         menu->addChild(new MenuEntry);
@@ -726,7 +2025,7 @@ struct SemitoneSequencerWidget : ModuleWidget
             int quantizationMode;
             void onAction(const event::Action &e) override
             {
-                module->quantizationMode = quantizationMode;
+                module->sendCommand(SequencerCommand::SET_QUANTIZATION_MODE, quantizationMode);
             }
         };
 
@@ -739,6 +2038,137 @@ struct SemitoneSequencerWidget : ModuleWidget
             qItem->quantizationMode = i;
             menu->addChild(qItem);
         }
+
+        /** Groove */
+        menu->addChild(new MenuEntry);
+        menu->addChild(createMenuLabel("Groove"));
+        struct GrooveItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            int groove;
+            void onAction(const event::Action &e) override
+            {
+                module->sendCommand(SequencerCommand::SET_GROOVE, groove);
+            }
+        };
+
+        for (int i = 0; i < NUM_BUILT_IN_GROOVES + SemitoneSequencer::NUM_USER_GROOVES; ++i)
+        {
+            const char *grooveName = (i < NUM_BUILT_IN_GROOVES)
+                                         ? BUILT_IN_GROOVES[i].name
+                                         : module->userGrooves[i - NUM_BUILT_IN_GROOVES].name;
+            GrooveItem *gItem = createMenuItem<GrooveItem>(grooveName);
+            gItem->rightText = CHECKMARK(module->grooveIndex == i);
+            gItem->module = module;
+            gItem->groove = i;
+            menu->addChild(gItem);
+        }
+
+        for (int i = 0; i < SemitoneSequencer::NUM_USER_GROOVES; ++i)
+        {
+            menu->addChild(createSubmenuItem(
+                std::string("Edit ") + module->userGrooves[i].name, RIGHT_ARROW,
+                [=](Menu *submenu)
+                { appendUserGrooveMenu(submenu, module, i); }));
+        }
+
+        /** Parameter locks for the steps of the selected measure. */
+        menu->addChild(new MenuEntry);
+        menu->addChild(createMenuLabel("Parameter locks"));
+        int lockMeasure = (int)module->params[SemitoneSequencer::MEASURE_SWITCH_PARAM].getValue();
+        for (int i = 0; i < module->numStepsPerMeasure; ++i)
+        {
+            int step = lockMeasure * 8 + i;
+            menu->addChild(createSubmenuItem(
+                "Step " + std::to_string(i + 1), (module->paramLocks.mask[step]) ? "Locked " RIGHT_ARROW : RIGHT_ARROW,
+                [=](Menu *submenu)
+                { appendParamLockMenu(submenu, module, step); }));
+        }
+
+        /** Ratchets for the steps of the selected measure. */
+        menu->addChild(new MenuEntry);
+        menu->addChild(createMenuLabel("Ratchets"));
+        for (int i = 0; i < module->numStepsPerMeasure; ++i)
+        {
+            int step = lockMeasure * 8 + i;
+            int count = module->stepRatchets[step];
+            menu->addChild(createSubmenuItem(
+                "Step " + std::to_string(i + 1), ((count > 1) ? std::to_string(count) + "x " : std::string()) + RIGHT_ARROW,
+                [=](Menu *submenu)
+                { appendRatchetMenu(submenu, module, step); }));
+        }
+
+        /** Audio rate mode */
+        menu->addChild(new MenuEntry);
+        menu->addChild(createBoolMenuItem(
+            "Audio rate mode", "",
+            [=]()
+            { return module->audioRate; },
+            [=](bool audioRate)
+            { module->sendCommand(SequencerCommand::SET_AUDIO_RATE, audioRate); }));
+        menu->addChild(createBoolMenuItem(
+            "Band-limit audio rate steps", "",
+            [=]()
+            { return module->audioRateBandLimit; },
+            [=](bool bandLimit)
+            { module->sendCommand(SequencerCommand::SET_AUDIO_RATE_BAND_LIMIT, bandLimit); }));
+
+        /** Pattern library */
+        menu->addChild(new MenuEntry);
+        menu->addChild(createMenuLabel("Pattern library"));
+        struct LoadPatternLibraryItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            void onAction(const event::Action &e) override
+            {
+                char *pathC = osdialog_file(OSDIALOG_OPEN, NULL, NULL, NULL);
+                if (!pathC)
+                    return;
+                std::string path = pathC;
+                std::free(pathC);
+                module->loadPatternLibrary(path);
+            }
+        };
+
+        struct AppendPatternItem : MenuItem
+        {
+            SemitoneSequencer *module;
+            void onAction(const event::Action &e) override
+            {
+                char *pathC = osdialog_file(OSDIALOG_SAVE, NULL, "patterns.repl", NULL);
+                if (!pathC)
+                    return;
+                std::string path = pathC;
+                std::free(pathC);
+
+                float octaves[32], semitones[32], stepActive[32];
+                for (int i = 0; i < 32; ++i)
+                {
+                    octaves[i] = module->params[SemitoneSequencer::FAKE_OCT_PARAM + i].getValue();
+                    semitones[i] = module->params[SemitoneSequencer::FAKE_SEMITONE_PARAM + i].getValue();
+                    stepActive[i] = module->params[SemitoneSequencer::FAKE_STEP_ACTIVE_PARAM + i].getValue();
+                }
+                PatternRecord record;
+                record.fromArrays(octaves, semitones, stepActive);
+                record.numStepsPerMeasure = module->numStepsPerMeasure;
+                record.numMeasures = module->numMeasures;
+                PatternLibrary::append(path, record);
+            }
+        };
+
+        std::string libraryName = (module->patternLibrary)
+                                      ? system::getFilename(module->patternLibrary->path()) + " (" +
+                                            std::to_string(module->patternLibrary->size()) + " patterns)"
+                                      : "None";
+        menu->addChild(createMenuLabel(libraryName));
+
+        LoadPatternLibraryItem *loadItem = createMenuItem<LoadPatternLibraryItem>("Load pattern library...");
+        loadItem->module = module;
+        menu->addChild(loadItem);
+
+        AppendPatternItem *appendItem = createMenuItem<AppendPatternItem>("Append pattern to library file...");
+        appendItem->module = module;
+        menu->addChild(appendItem);
     }
 
     SemitoneSequencerWidget(SemitoneSequencer *module)
@@ -804,6 +2234,7 @@ struct SemitoneSequencerWidget : ModuleWidget
         addInput(createInputCentered<TAR::Components::Port1>(mm2px(Vec(27.94f, 103.1f)), module, SemitoneSequencer::RESET_INPUT));
         addOutput(createOutputCentered<TAR::Components::Port1>(mm2px(Vec(43.18f, 103.1f)), module, SemitoneSequencer::GATE_OUTPUT));
         addOutput(createOutputCentered<TAR::Components::Port1>(mm2px(Vec(58.42, 103.1f)), module, SemitoneSequencer::CV_OUTPUT));
+        addInput(createInputCentered<TAR::Components::Port1>(mm2px(Vec(73.66f, 103.1f)), module, SemitoneSequencer::PATTERN_SELECT_INPUT));
 
         addChild(createLightCentered<MediumLight<TAR::Components::BlueWhiteLight>>(mm2px(Vec(5.08f, 21.82f - 5.08f)), module, SemitoneSequencer::CURRENT_LIGHT1_LIGHT));
         addChild(createLightCentered<MediumLight<TAR::Components::BlueWhiteLight>>(mm2px(Vec(5.08f, 42.14f - 5.08f)), module, SemitoneSequencer::CURRENT_LIGHT2_LIGHT));
@@ -824,6 +2255,12 @@ struct SemitoneSequencerWidget : ModuleWidget
         sequencerWidget->box.size = mm2px(Vec(50.8f, 18.0f));
         sequencerWidget->setWidget((module) ? module : NULL);
         addChild(sequencerWidget);
+
+        PatternOverview *patternOverview = createWidget<PatternOverview>(
+            mm2px(rack::math::Vec(81.28f, 46.0f)));
+        patternOverview->box.size = mm2px(Vec(50.8f, 36.0f));
+        patternOverview->setSource((module) ? &module->patternSnapshot : NULL);
+        addChild(patternOverview);
     }
 };
 
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <utility>
+#include <vector>
 #include "plugin.hpp"
 #include "common/SequencerWidget.hpp"
 #include "common/RosEngineering.hpp"
 #include "common/REComponents.hpp"
 #include "common/Quantizer.hpp"
 #include "common/SlewLimiter.hpp"
+#include "common/Glide.hpp"
+#include "common/PatternLibrary.hpp"
+#include "common/Groove.hpp"
+#include "common/ParamLocks.hpp"
+#include "common/GateScheduler.hpp"
+#include "common/ExpanderBus.hpp"
+#include "common/CommandQueue.hpp"
+#include "common/Seqlock.hpp"
+#include "common/LFOBank.hpp"
+#include "common/SmoothRandom.hpp"
 
 class TuningModulator
 {
@@ -13,11 +26,97 @@ public:
     TuningModulator();
 
     float randomSquareLFO(bool gate);
-    float sineLFO(float pitch, float sampleTime, float pitchAttenuation);
-    float randomSmoothLFO(float currentValue, float lastValue, float phase);
+};
+
+/**
+ * @struct SequencerLanes
+ * @brief Playhead state for the independent lanes used when the clock or reset
+ * input carries more than one channel.
+ *
+ * Every lane loops over its own measure of the pattern (lane % number of measures).
+ * State is stored as structure-of-arrays so that the per-sample work is done four
+ * lanes at a time. Step changes are rare and are handled one lane at a time.
+ */
+struct SequencerLanes
+{
+    static const int MAX_LANES = 16;
+    static const int NUM_BLOCKS = MAX_LANES / 4;
+
+    simd::float_4 phase[NUM_BLOCKS];
+    simd::float_4 pitch[NUM_BLOCKS];
+    simd::float_4 slew[NUM_BLOCKS];
+    simd::float_4 detune[NUM_BLOCKS];
+    simd::float_4 gateRand[NUM_BLOCKS];
+    simd::int32_4 step[NUM_BLOCKS];
+    simd::float_4 lockedValue[ParamLocks::NUM_LOCKS][NUM_BLOCKS];
+    simd::int32_4 lockedMask[ParamLocks::NUM_LOCKS][NUM_BLOCKS];
+    dsp::TSchmittTrigger<simd::float_4> clockTrigger[NUM_BLOCKS];
+    dsp::TSchmittTrigger<simd::float_4> resetTrigger[NUM_BLOCKS];
+    int numLanes = 0;
+
+    SequencerLanes() { reset(); }
+
+    void reset()
+    {
+        for (int b = 0; b < NUM_BLOCKS; ++b)
+        {
+            phase[b] = 0.f;
+            pitch[b] = 0.f;
+            slew[b] = 0.f;
+            detune[b] = 0.f;
+            gateRand[b] = 0.f;
+            step[b] = 0;
+            for (int lock = 0; lock < ParamLocks::NUM_LOCKS; ++lock)
+            {
+                lockedValue[lock][b] = 0.f;
+                lockedMask[lock][b] = 0;
+            }
+            clockTrigger[b].reset();
+            resetTrigger[b].reset();
+        }
+    }
+};
 
-private:
-    float m_Phase;
+/**
+ * @struct SequencerCommand
+ * @brief One edit from the UI thread, applied by the audio thread.
+ *
+ * index and index2 are the command's integer arguments, for example the step and
+ * the lock, and value is its float argument.
+ */
+struct SequencerCommand
+{
+    enum Type
+    {
+        SET_STEPS_PER_MEASURE,
+        SET_NUM_MEASURES,
+        SET_CHORD_MODE,
+        SET_DETUNE_MODE,
+        SET_QUANTIZATION_MODE,
+        SET_GROOVE,
+        SET_USER_GROOVE_LENGTH,
+        SET_USER_GROOVE_OFFSET,
+        SET_USER_GROOVE_GATE_LENGTH,
+        SET_PARAM_LOCK,
+        CLEAR_PARAM_LOCK,
+        SET_RATCHETS,
+        SET_RATCHET_CURVE,
+        SET_AUDIO_RATE,
+        SET_AUDIO_RATE_BAND_LIMIT,
+        SET_LFO_SPREAD,
+        SET_LFO_DECORRELATION,
+        SET_RANDOM_KERNEL,
+        SET_SLIDE_CURVE,
+        SET_SLIDE_MODE,
+        SET_GLIDE_SYNC,
+        SET_GLIDE_LEGATO,
+        ACKNOWLEDGE_PATTERN_LIBRARY
+    };
+
+    Type type;
+    int index;
+    int index2;
+    float value;
 };
 
 struct SemitoneSequencer : Module
@@ -68,6 +167,7 @@ struct SemitoneSequencer : Module
     {
         RESET_INPUT,
         CLOCK_INPUT,
+        PATTERN_SELECT_INPUT,
         NUM_INPUTS
     };
     enum OutputIds
@@ -130,18 +230,26 @@ struct SemitoneSequencer : Module
         RANDOM_LFO
     };
     dsp::SchmittTrigger trigger, resetTrigger, runningTrigger, randSqrTrigger, stepActiveTrigger;
-    dsp::BooleanTrigger swingTrigger;
     dsp::PulseGenerator changedMeasureNumberPulse;
     dsp::Timer switchTimer, lengthTimer;
-    // dsp::ExponentialSlewLimiter slewLimiter;
-    // dsp::SlewLimiter slewLimiter[4];
-    SlewLimiter slew[4];
-    bool running = true;
+    enum SlideMode
+    {
+        SLIDE_SLEW,
+        SLIDE_GLIDE_TIME,
+        SLIDE_GLIDE_RATE,
+        NUM_SLIDE_MODES
+    };
+    TSlewLimiter<simd::float_4> slew;
+    GlideEngine glide;
+    int slideMode = SLIDE_SLEW;
+    bool running = false;
     bool gate = false;
-    int numStepsPerMeasure = 0;
-    int numMeasures = 69;
+    int numStepsPerMeasure = 8;
+    int numMeasures = 4;
     int stepNumber = 0;
     int numStepsToIncrement = 1;
+    /** Whether the current step follows the last one with no inactive steps between. */
+    bool legato = true;
     int measureNumber = 0;
     float phase = 0.f;
     int detuneMode = RANDOM_GATE;
@@ -152,10 +260,124 @@ struct SemitoneSequencer : Module
     int lastMeasureNumber = 0;
     int numToUseForMeasureLights = 0;
     TuningModulator lfo[4];
+    SineLFOBank sineLFO;
+    SmoothRandomBank randomLFO;
+    float lfoSpread = 0.0f;
+    float lfoDecorrelation = 0.0f;
     float randValue = 0.0f;
-    float randLFOValue = 0.0f;
-    float randLFOLastValue = 0.0f;
     Quantizer quantizer;
+    SequencerLanes lanes;
+
+    /**
+     * The pattern library is shared with every other instance that loaded the same
+     * file. The audio thread only ever reads activePatternLibrary. Every swap is
+     * followed by an ACKNOWLEDGE_PATTERN_LIBRARY command carrying a new generation,
+     * and once the audio thread has applied it, it can't still hold an older
+     * pointer. A replaced library is kept alive until its generation has been
+     * acknowledged, so it can't be unmapped under the audio thread.
+     */
+    std::shared_ptr<const PatternLibrary> patternLibrary;
+    std::vector<std::pair<uint32_t, std::shared_ptr<const PatternLibrary>>> retiredPatternLibraries;
+    uint32_t patternLibraryGeneration = 0;
+    std::atomic<uint32_t> acknowledgedPatternLibrary{0};
+    std::atomic<const PatternLibrary *> activePatternLibrary{nullptr};
+
+    /**
+     * Edits from the UI thread. Menus and displays read module fields directly, \n
+     * but only ever change them by sending a command, which the audio thread \n
+     * applies at the start of process().
+     */
+    CommandQueue<SequencerCommand, 256> commands;
+
+    /**
+     * Groove state. The groove table is rebuilt on the audio thread whenever the \n
+     * tempo, swing or groove changes, and grooveDirty requests a rebuild after \n
+     * the selection or a user groove is edited.
+     */
+    static const int NUM_USER_GROOVES = 4;
+    int grooveIndex = 0;
+    GrooveTemplate userGrooves[NUM_USER_GROOVES];
+    GrooveTable grooveTable;
+    bool grooveDirty = true;
+    bool grooveActive = false;
+    float grooveClock = 0.0f;
+    float grooveSwing = 0.0f;
+    float grooveSampleRate = 0.0f;
+    int grooveStep = 0;
+    int stepSample = 0;
+    float stepPhaseIncrement = 0.0f;
+    int samplesSinceClock = 0;
+    int clockPeriod = 0;
+    int stepDelay = 0;
+    bool stepPending = false;
+
+    /**
+     * Parameter locks, and the locks of the current step. These are resolved at \n
+     * each step event so the per-sample path only checks activeLocks.
+     */
+    ParamLocks paramLocks;
+    uint8_t activeLocks = 0;
+    float lockedValues[ParamLocks::NUM_LOCKS] = {};
+    int stepGateSamples = 0;
+
+    /**
+     * Ratchets. Each step retriggers its gate 1 - 8 times, spaced by its curve. \n
+     * All of a step's gate edges are scheduled when the step starts, so the \n
+     * per-sample gate is a single compare against the next pending edge.
+     */
+    static const int MAX_RATCHETS = 8;
+    uint8_t stepRatchets[32];
+    uint8_t stepRatchetCurves[32] = {};
+    GateScheduler gateScheduler;
+    int64_t sampleCounter = 0;
+    bool gateFollowsClock = true;
+
+    /**
+     * Audio rate mode. The pattern's active steps are baked into a voltage table \n
+     * with one step of wraparound padding at each end, so the per-sample work is \n
+     * a phase increment and a table read. The table, knob write-back and lights \n
+     * are only refreshed every AUDIO_RATE_DIVISION samples.
+     */
+    static const int AUDIO_RATE_DIVISION = 64;
+    bool audioRate = false;
+    bool audioRateBandLimit = true;
+    float audioRateTable[32 + 2] = {};
+    int audioRateLength = 1;
+    simd::float_4 audioRatePhase[4];
+    dsp::ClockDivider audioRateDivider;
+
+    /**
+     * The pattern and playhead for the overview display. A new snapshot is only \n
+     * published when something in it has changed, checked every \n
+     * SNAPSHOT_DIVISION samples.
+     */
+    static const int SNAPSHOT_DIVISION = 256;
+    Seqlock<PatternSnapshot> patternSnapshot;
+    PatternSnapshot publishedSnapshot = {};
+    dsp::ClockDivider snapshotDivider;
+
+    /** Version of the pattern blob saved by dataToJson. */
+    static const uint8_t PATTERN_BLOB_VERSION = 1;
+    /** Whether the last dataFromJson() found a usable pattern blob. */
+    bool patternBlobLoaded = false;
+
+    /** Counts step events for modules on the expander bus. */
+    uint32_t stepCount = 0;
+
+    /** Returns the current step's locked value, or paramValue if it isn't locked. */
+    float lockedOr(int lock, float paramValue) const
+    {
+        return (activeLocks & (1 << lock)) ? lockedValues[lock] : paramValue;
+    }
+
+    /**
+     * Returns the index into the 8-wide pattern arrays, measure * 8 + step, of a \n
+     * playhead step. The same index the CV output reads.
+     */
+    int patternStep(int step) const
+    {
+        return step + (step / numStepsPerMeasure) * (8 - numStepsPerMeasure);
+    }
 
     /**
      * This overrides the display values for the mode param such that
@@ -228,13 +450,29 @@ struct SemitoneSequencer : Module
 
     void onReset() override;
     void onRandomize() override;
-    void onAdd() override;
 
     json_t *dataToJson() override;
     void dataFromJson(json_t *) override;
+    void fromJson(json_t *) override;
+    void importLegacyPattern(json_t *);
 
+    bool loadPatternLibrary(const std::string &);
+    void sendCommand(SequencerCommand::Type, int = 0, int = 0, float = 0.0f);
+    void applyCommands();
     void setStep(int, int);
-    void resetRandLFO();
+    void advanceStep(const float *);
+    const GrooveTemplate &currentGroove() const;
+    void updateGrooveTable(float);
+    void resolveLocks(int);
+    void setSlideMode(int);
+    void scheduleGates(int, int);
+    float stepPitch(int, const float *, const float *);
+    int advanceLaneStep(int, int, const float *);
+    void processLanes(const ProcessArgs &, const float *, const float *, const float *);
+    void sendExpanderMessage();
+    void publishSnapshot(const float *, const float *, const float *, int);
+    void updateAudioRateTable();
+    void processAudioRate(const ProcessArgs &);
 
     void process(const ProcessArgs &) override;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../plugin.hpp"
+
+/**
+ * @class BlockRamp
+ * @brief Block-rate parameter snapshots, ramped linearly at audio rate.
+ *
+ * The module reads its knobs once per block and hands the values to
+ * snapshot(), which sets every value off in a straight line from where the
+ * last block ended to its new target. process() then takes one step per
+ * sample, and after length steps each value lands exactly on its target.
+ *
+ * Values are kept in groups of four, one simd::float_4 each. Only the groups
+ * whose targets changed step at all, so when no knob is moving process() is a
+ * single test, and when every knob is moving it is one add per group.
+ *
+ * @tparam SIZE is the number of values, a multiple of 4.
+ */
+template <int SIZE>
+class BlockRamp
+{
+public:
+    static_assert(SIZE % 4 == 0, "BlockRamp holds whole groups of four");
+    static const int NUM_GROUPS = SIZE / 4;
+
+    BlockRamp()
+    {
+        for (int g = 0; g < NUM_GROUPS; ++g)
+        {
+            m_Value[g] = 0.f;
+            m_Target[g] = 0.f;
+            m_Step[g] = 0.f;
+        }
+    }
+
+    /**
+     * Starts a block.
+     *
+     * @param targets holds SIZE values to reach by the end of the block.
+     * @param length is the number of process() calls in the block.
+     * @return a mask of the groups that will move.
+     */
+    int snapshot(const float *targets, int length)
+    {
+        m_Ramping = 0;
+        for (int g = 0; g < NUM_GROUPS; ++g)
+        {
+            const simd::float_4 target = simd::float_4::load(&targets[g * 4]);
+            m_Value[g] = m_Target[g];
+            if (simd::movemask(target != m_Target[g]))
+            {
+                m_Step[g] = (target - m_Value[g]) / static_cast<float>(length);
+                m_Target[g] = target;
+                m_Ramping |= 1 << g;
+            }
+        }
+        m_Remaining = length;
+        return m_Ramping;
+    }
+
+    /**
+     * Moves a group straight to its target, for values that mustn't pass through
+     * the ones between. Call it after snapshot().
+     */
+    void jump(int g)
+    {
+        m_Value[g] = m_Target[g];
+        m_Ramping &= ~(1 << g);
+    }
+
+    /**
+     * Advances every moving group by one sample.
+     *
+     * @return a mask of the groups that moved.
+     */
+    int process()
+    {
+        const int moved = m_Ramping;
+        if (!moved)
+            return 0;
+
+        if (--m_Remaining > 0)
+        {
+            for (int g = 0; g < NUM_GROUPS; ++g)
+            {
+                if (moved & (1 << g))
+                    m_Value[g] += m_Step[g];
+            }
+        }
+        else
+        {
+            for (int g = 0; g < NUM_GROUPS; ++g)
+                m_Value[g] = m_Target[g];
+            m_Ramping = 0;
+        }
+        return moved;
+    }
+
+    const simd::float_4 *groups() const { return m_Value; }
+    simd::float_4 group(int g) const { return m_Value[g]; }
+    float get(int i) const { return m_Value[i / 4].s[i % 4]; }
+
+private:
+    simd::float_4 m_Value[NUM_GROUPS];
+    simd::float_4 m_Target[NUM_GROUPS];
+    simd::float_4 m_Step[NUM_GROUPS];
+    int m_Ramping = 0;
+    int m_Remaining = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @class CommandQueue
+ * @brief A preallocated single-producer, single-consumer ring of commands.
+ *
+ * The UI thread pushes and the audio thread pops, so neither side ever locks or
+ * allocates. A push onto a full queue fails rather than blocking, and the caller
+ * can drop the edit. Each command is published by a release store of the tail,
+ * so the consumer never sees a half-written command.
+ *
+ * @tparam T is a trivially copyable command.
+ * @tparam CAPACITY must be a power of 2.
+ */
+template <typename T, uint32_t CAPACITY>
+class CommandQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CommandQueue capacity must be a power of 2");
+
+public:
+    /** Called from the producer thread only. */
+    bool push(const T &command)
+    {
+        const uint32_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_Head.load(std::memory_order_acquire) >= CAPACITY)
+            return false;
+
+        m_Commands[tail & (CAPACITY - 1)] = command;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Called from the consumer thread only. */
+    bool pop(T &command)
+    {
+        const uint32_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_Tail.load(std::memory_order_acquire))
+            return false;
+
+        command = m_Commands[head & (CAPACITY - 1)];
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Cheap check for the consumer, so an empty queue costs one load. */
+    bool empty() const
+    {
+        return m_Head.load(std::memory_order_relaxed) == m_Tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_Commands[CAPACITY];
+    std::atomic<uint32_t> m_Head{0};
+    std::atomic<uint32_t> m_Tail{0};
+};
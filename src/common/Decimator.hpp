@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cmath>
+#include "../plugin.hpp"
+
+/**
+ * @class HalfBandDecimator
+ * @brief Halves the sample rate of four voices at once with a linear phase,
+ * half-band FIR filter.
+ *
+ * Every other tap of a half-band filter is zero except the center one, which is
+ * 0.5. Split polyphase, the even input samples go through the nonzero taps and
+ * the odd ones only need a delay, so each output costs HALF symmetric pairs:
+ * HALF multiplies and 2 * HALF adds for four voices.
+ *
+ * The taps are a Kaiser windowed sinc, worked out once in the constructor.
+ *
+ * @tparam HALF is the number of nonzero taps on each side of the center. The
+ * filter is 4 * HALF - 1 taps long and delays by 2 * HALF - 1 input samples.
+ */
+template <int HALF>
+class HalfBandDecimator
+{
+public:
+    HalfBandDecimator(float beta = 8.0f)
+    {
+        const int center = 2 * HALF - 1;
+        double taps[HALF];
+        double sum = 0.0;
+        for (int k = 0; k < HALF; ++k)
+        {
+            const double n = 2 * k + 1;
+            const double sinc = std::sin(M_PI * n / 2.0) / (M_PI * n);
+            const double r = n / center;
+            taps[k] = sinc * bessel0(beta * std::sqrt(1.0 - r * r)) / bessel0(beta);
+            sum += 2.0 * taps[k];
+        }
+
+        /** Unity gain at DC, where the center tap gives half. */
+        for (int k = 0; k < HALF; ++k)
+            m_Coefficients[k] = static_cast<float>(0.5 * taps[k] / sum);
+        reset();
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < 2 * EVEN_LENGTH; ++i)
+            m_Even[i] = 0.f;
+        for (int i = 0; i < 2 * ODD_LENGTH; ++i)
+            m_Odd[i] = 0.f;
+        m_EvenPosition = 0;
+        m_OddPosition = 0;
+    }
+
+    /**
+     * @param older and newer are two consecutive input samples.
+     * @return one output sample.
+     */
+    simd::float_4 process(simd::float_4 older, simd::float_4 newer)
+    {
+        m_EvenPosition = (m_EvenPosition == 0) ? EVEN_LENGTH - 1 : m_EvenPosition - 1;
+        m_Even[m_EvenPosition] = m_Even[m_EvenPosition + EVEN_LENGTH] = newer;
+        m_OddPosition = (m_OddPosition == 0) ? ODD_LENGTH - 1 : m_OddPosition - 1;
+        m_Odd[m_OddPosition] = m_Odd[m_OddPosition + ODD_LENGTH] = older;
+
+        /** Newest first, so tap k pairs the samples HALF - 1 - k and HALF + k back. */
+        const simd::float_4 *even = &m_Even[m_EvenPosition];
+        simd::float_4 out = 0.5f * m_Odd[m_OddPosition + HALF - 1];
+        for (int k = 0; k < HALF; ++k)
+            out += m_Coefficients[k] * (even[HALF - 1 - k] + even[HALF + k]);
+        return out;
+    }
+
+private:
+    static const int EVEN_LENGTH = 2 * HALF;
+    static const int ODD_LENGTH = HALF;
+
+    static double bessel0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /** Each delay line is stored twice over, so a window never wraps. */
+    simd::float_4 m_Even[2 * EVEN_LENGTH];
+    simd::float_4 m_Odd[2 * ODD_LENGTH];
+    int m_EvenPosition;
+    int m_OddPosition;
+    float m_Coefficients[HALF];
+};
+
+/**
+ * @class OversamplingDecimator
+ * @brief Brings four voices back down from 2x, 4x or 8x with a cascade of
+ * half-band stages.
+ *
+ * Only the last stage has to keep the whole audio band, so it gets the long
+ * filter. The earlier stages run at higher rates, where everything they have to
+ * keep is far below their cutoff, so short filters do.
+ */
+class OversamplingDecimator
+{
+public:
+    static const int MAX_FACTOR = 8;
+
+    /** @param factor is 1, 2, 4 or 8. */
+    void setFactor(int factor)
+    {
+        m_Factor = factor;
+        reset();
+    }
+    int getFactor() const { return m_Factor; }
+
+    void reset()
+    {
+        m_Last.reset();
+        m_Middle.reset();
+        m_First.reset();
+    }
+
+    /**
+     * @param in holds factor samples, oldest first. It is overwritten.
+     * @return one sample at the base rate.
+     */
+    simd::float_4 process(simd::float_4 *in)
+    {
+        switch (m_Factor)
+        {
+        case 8:
+            for (int i = 0; i < 4; ++i)
+                in[i] = m_First.process(in[2 * i], in[2 * i + 1]);
+            // fall through
+        case 4:
+            for (int i = 0; i < 2; ++i)
+                in[i] = m_Middle.process(in[2 * i], in[2 * i + 1]);
+            // fall through
+        case 2:
+            return m_Last.process(in[0], in[1]);
+        default:
+            return in[0];
+        }
+    }
+
+private:
+    int m_Factor = 1;
+    HalfBandDecimator<16> m_Last;
+    HalfBandDecimator<4> m_Middle;
+    HalfBandDecimator<3> m_First;
+};
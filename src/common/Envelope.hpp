@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cmath>
+#include "../plugin.hpp"
+
+/**
+ * @class ADSRCoefficients
+ * @brief The per-sample multipliers of an ADSR envelope, shared by every voice
+ * that plays it.
+ *
+ * Every segment is a one pole step, value = base + value * coefficient, so the
+ * exponentials are only worked out here, when a time changes. The attack aims
+ * past 1 and stops there, which gives it the usual analog shape. Decay and
+ * release are pure exponentials, and their times are to within 60 dB.
+ */
+class ADSRCoefficients
+{
+public:
+    /**
+     * @param attack, decay and release are in seconds.
+     * @param sustain is from 0 to 1.
+     */
+    void set(float attack, float decay, float sustain, float release, float sampleTime)
+    {
+        if (attack != m_Attack || sampleTime != m_SampleTime)
+            attackCoefficient = segment(attack, sampleTime, std::log((1.0f + ATTACK_OVERSHOOT) / ATTACK_OVERSHOOT));
+        if (decay != m_Decay || sampleTime != m_SampleTime)
+            decayCoefficient = segment(decay, sampleTime, std::log(1000.0f));
+        if (release != m_Release || sampleTime != m_SampleTime)
+            releaseCoefficient = segment(release, sampleTime, std::log(1000.0f));
+
+        m_Attack = attack;
+        m_Decay = decay;
+        m_Release = release;
+        m_SampleTime = sampleTime;
+
+        attackBase = (1.0f + ATTACK_OVERSHOOT) * (1.0f - attackCoefficient);
+        decayBase = sustain * (1.0f - decayCoefficient);
+    }
+
+    float attackBase = 0.0f;
+    float attackCoefficient = 0.0f;
+    float decayBase = 0.0f;
+    float decayCoefficient = 0.0f;
+    float releaseCoefficient = 0.0f;
+
+private:
+    static constexpr float ATTACK_OVERSHOOT = 0.3f;
+
+    /** The coefficient that covers a segment whose log ratio is span in time seconds. */
+    static float segment(float time, float sampleTime, float span)
+    {
+        return std::exp(-span * sampleTime / std::max(time, sampleTime));
+    }
+
+    float m_Attack = -1.0f;
+    float m_Decay = -1.0f;
+    float m_Release = -1.0f;
+    float m_SampleTime = -1.0f;
+};
+
+/**
+ * @class ADSREnvelope
+ * @brief An ADSR envelope for four voices at once.
+ *
+ * Each lane picks its base and coefficient by select, so the four voices can sit
+ * in different segments with no branches. A new gate attacks from wherever the
+ * lane is. Once the gate is low and the release falls below -80 dB, the lane
+ * snaps to 0 and stays there, and when all four lanes have, the envelope is
+ * idle and its voices can be skipped.
+ */
+class ADSREnvelope
+{
+public:
+    ADSREnvelope() { reset(); }
+
+    void reset()
+    {
+        m_Value = 0.f;
+        m_Gate = 0.f;
+        m_Attacking = 0.f;
+    }
+
+    /**
+     * Advances the envelope by one sample.
+     *
+     * @param gate is a mask, set in every lane whose gate is high.
+     * @return the envelope, from 0 to 1.
+     */
+    simd::float_4 process(simd::float_4 gate, const ADSRCoefficients &coefficients)
+    {
+        m_Attacking = (m_Attacking | (gate & ~m_Gate)) & gate;
+        m_Gate = gate;
+
+        const simd::float_4 base = simd::ifelse(m_Attacking, simd::float_4(coefficients.attackBase),
+                                                simd::ifelse(gate, simd::float_4(coefficients.decayBase), simd::float_4(0.f)));
+        const simd::float_4 coefficient = simd::ifelse(m_Attacking, simd::float_4(coefficients.attackCoefficient),
+                                                       simd::ifelse(gate, simd::float_4(coefficients.decayCoefficient),
+                                                                    simd::float_4(coefficients.releaseCoefficient)));
+        m_Value = base + m_Value * coefficient;
+
+        const simd::float_4 peaked = m_Value >= 1.0f;
+        m_Attacking = m_Attacking & ~peaked;
+        m_Value = simd::fmin(m_Value, simd::float_4(1.0f));
+        m_Value = simd::ifelse(~gate & (m_Value < 1e-4f), simd::float_4(0.f), m_Value);
+        return m_Value;
+    }
+
+    bool isIdle() const
+    {
+        return !simd::movemask(m_Gate) && !simd::movemask(m_Value != 0.f);
+    }
+
+private:
+    simd::float_4 m_Value;
+    simd::float_4 m_Gate;
+    simd::float_4 m_Attacking;
+};
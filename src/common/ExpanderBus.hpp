@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "../plugin.hpp"
+
+/**
+ * @struct ExpanderMessage
+ * @brief The fixed layout exchanged between adjacent RosEngineering modules.
+ *
+ * A producer writes into its right neighbour's leftExpander.producerMessage and
+ * requests a flip. Rack swaps the consumer's two buffers at the end of the engine
+ * frame, so the consumer reads it the next sample, the same timing as a cable,
+ * but without any port traffic. The consumer owns both buffers.
+ *
+ * Guide notes are pitch classes in V/Oct, from 0 to 1. An empty guide set means
+ * the producer isn't quantizing.
+ *
+ * The bus only runs left to right, from the sequencer to the modules it drives.
+ * Nothing downstream has anything the sequencer needs, so there is no return
+ * path through rightExpander.
+ */
+struct ExpanderMessage
+{
+    static const uint32_t MAGIC = 0x52454255; // "REBU"
+    static const uint32_t VERSION = 1;
+    static const int MAX_CHANNELS = 16;
+
+    uint32_t magic;
+    uint32_t version;
+
+    /** Step events. stepCount goes up by one at every step. */
+    uint32_t stepCount;
+    int32_t step;
+    float clockPhase;
+
+    /** CV and gate, one per channel, chord voices included. */
+    int32_t channels;
+    float cv[MAX_CHANNELS];
+    float gate[MAX_CHANNELS];
+
+    /** Chord and guide sets */
+    int32_t chordMode;
+    int32_t numGuideNotes;
+    float guideNotes[12];
+};
+
+static_assert(std::is_trivially_copyable<ExpanderMessage>::value, "ExpanderMessage must stay plain-old-data");
+
+namespace ExpanderBus
+{
+
+/** Whether a module reads ExpanderMessages on its left side. */
+inline bool acceptsMessages(const Module *module)
+{
+    return module && module->model == modelGuideQuant;
+}
+
+/** Whether a module sends ExpanderMessages to its right side. */
+inline bool sendsMessages(const Module *module)
+{
+    return module && module->model == modelSemitoneSequencer;
+}
+
+/** Allocates a consumer's buffers. Call from the consumer's constructor. */
+inline void attachConsumer(Module *module, ExpanderMessage *buffers)
+{
+    std::memset(buffers, 0, 2 * sizeof(ExpanderMessage));
+    module->leftExpander.producerMessage = &buffers[0];
+    module->leftExpander.consumerMessage = &buffers[1];
+}
+
+/**
+ * Returns the right neighbour's message buffer to fill, or null if there is no
+ * neighbour that takes messages. Follow with send().
+ */
+inline ExpanderMessage *beginSend(Module *module)
+{
+    Module *right = module->rightExpander.module;
+    if (!acceptsMessages(right))
+        return nullptr;
+
+    ExpanderMessage *message = static_cast<ExpanderMessage *>(right->leftExpander.producerMessage);
+    message->magic = ExpanderMessage::MAGIC;
+    message->version = ExpanderMessage::VERSION;
+    return message;
+}
+
+inline void send(Module *module)
+{
+    module->rightExpander.module->leftExpander.requestMessageFlip();
+}
+
+/** Returns the message from the left neighbour, or null if there isn't a valid one. */
+inline const ExpanderMessage *receive(const Module *module)
+{
+    if (!sendsMessages(module->leftExpander.module))
+        return nullptr;
+
+    const ExpanderMessage *message = static_cast<const ExpanderMessage *>(module->leftExpander.consumerMessage);
+    if (!message || message->magic != ExpanderMessage::MAGIC || message->version != ExpanderMessage::VERSION)
+        return nullptr;
+    return message;
+}
+
+} // namespace ExpanderBus
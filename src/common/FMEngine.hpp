@@ -0,0 +1,494 @@
+#pragma once
+
+#include "../plugin.hpp"
+#include "REMath.hpp"
+#include "PolyBlep.hpp"
+#include "Wavetable.hpp"
+
+/**
+ * @class FMOperatorBank
+ * @brief Four phase modulation operators for up to 16 voices of up to 8 unison
+ * copies each.
+ *
+ * Operator state is stored as structure-of-arrays, [operator][block], where a
+ * block is a simd::float_4 of four voices. The inner loop runs one operator for
+ * four voices at a time, so the FM matrix entries are plain scalars that
+ * multiply whole blocks, and every operator's waveform is the same across its
+ * lanes.
+ *
+ * Each sample, the operators' last outputs go through the 4x4 FM matrix. In
+ * phase mode the result offsets every operator's phase, and in linear mode it
+ * scales every operator's increment, which may go through zero and run the
+ * phase backwards. The one sample delay through the matrix is what lets an
+ * operator modulate itself or any other operator, in any order.
+ *
+ * Phases are 32 bit fixed point, a whole cycle being 2^32, kept in int32_4
+ * lanes. Adding wraps them for free, they are equally fine at any frequency and
+ * after any length of time, and the signed difference of two phases is the
+ * shorter way around. They only become floats for the waveform itself.
+ *
+ * Saw and pulse get PolyBLEP corrections at their jumps and the triangle gets
+ * PolyBLAMP corrections at its corners. The corrections use how far each
+ * voice's modulated phase actually moved this sample, so they stay in place
+ * under FM.
+ *
+ * In wavetable mode, each operator's waveform is a morph position through the
+ * shared Wavetable instead. Each voice picks its mip level from how far its
+ * modulated phase moved, and reads it with linear or cubic interpolation. The
+ * shapes stand in until the table has been built.
+ *
+ * The caller fills increment, level and pulseWidth for the active blocks, calls process()
+ * and reads out. process<2>() runs two blocks, eight voices, side by side, which
+ * gives the CPU two independent chains to overlap.
+ *
+ * Silent work is skipped. Operators the caller marks inactive are never run and
+ * output 0, and so is an operator whose level is 0 across a whole block.
+ *
+ * The per-sample work is done by kernel(), a template over a routing bitmask
+ * with bit 4 * n + m set if operator m may modulate operator n. Matrix entries
+ * outside the mask are left out at compile time, and so is the modulation of an
+ * operator with an empty row. setMatrix() picks the smallest common topology
+ * that covers the routing it is given, and the generic kernel, with every bit set,
+ * takes anything else.
+ */
+class FMOperatorBank
+{
+public:
+    enum Waveform
+    {
+        SINE,
+        TRIANGLE,
+        SAW,
+        PULSE,
+        NUM_WAVEFORMS
+    };
+
+    enum WaveformMode
+    {
+        SHAPES,
+        WAVETABLE,
+        NUM_WAVEFORM_MODES
+    };
+
+    enum Interpolation
+    {
+        LINEAR,
+        CUBIC,
+        NUM_INTERPOLATIONS
+    };
+
+    enum FMMode
+    {
+        PHASE_MODULATION,
+        LINEAR_THROUGH_ZERO,
+        NUM_FM_MODES
+    };
+
+    static const int NUM_OPERATORS = 4;
+    static const int MAX_VOICES = 16;
+    static const int MAX_UNISON = 8;
+    static const int NUM_VOICE_BLOCKS = MAX_VOICES / 4;
+    static const int NUM_BLOCKS = NUM_VOICE_BLOCKS * MAX_UNISON;
+
+    /** In phase mode, an FM amount of 1 offsets the modulated phase by up to one cycle. */
+    static constexpr float MAX_FM_DEPTH = 1.0f;
+    /** In linear mode, an FM amount of 1 swings the increment by up to 4 times itself. */
+    static constexpr float MAX_LINEAR_FM_DEPTH = 4.0f;
+
+    /** Per operator and block: frequency times sample time, from -0.5 to 0.5. */
+    simd::float_4 increment[NUM_OPERATORS][NUM_BLOCKS];
+    /** Per operator and block: output level, which also scales its modulation. */
+    simd::float_4 level[NUM_OPERATORS][NUM_BLOCKS];
+    /** Per operator and block: pulse width, from 0 to 1. Only used by the pulse. */
+    simd::float_4 pulseWidth[NUM_OPERATORS][NUM_BLOCKS];
+    /** Per operator and block: the last output, from -1 to 1 at full level. */
+    simd::float_4 out[NUM_OPERATORS][NUM_BLOCKS];
+
+    FMOperatorBank() { reset(); }
+
+    void reset()
+    {
+        for (int op = 0; op < NUM_OPERATORS; ++op)
+        {
+            for (int b = 0; b < NUM_BLOCKS; ++b)
+            {
+                m_Phase[op][b] = 0;
+                m_ModulatedPhase[op][b] = 0;
+                increment[op][b] = 0.f;
+                pulseWidth[op][b] = 0.5f;
+                level[op][b] = 0.f;
+                out[op][b] = 0.f;
+            }
+            m_Waveform[op] = SINE;
+            m_Frame[op] = 0;
+            m_Morph[op] = 0.0f;
+            for (int m = 0; m < NUM_OPERATORS; ++m)
+                m_Matrix[op][m] = 0.0f;
+        }
+        selectKernel(0);
+    }
+
+    /**
+     * @param fm is the FM matrix by rows, where fm[n].s[m] is how much operator
+     * m modulates operator n, from 0 to 1.
+     * @param routing must cover every nonzero entry. It can be wider, so that a
+     * matrix ramping an entry to or from 0 keeps one kernel for the whole ramp.
+     */
+    void setMatrix(const simd::float_4 fm[NUM_OPERATORS], int routing)
+    {
+        const float depth = (m_FMMode == LINEAR_THROUGH_ZERO) ? MAX_LINEAR_FM_DEPTH : MAX_FM_DEPTH;
+        for (int n = 0; n < NUM_OPERATORS; ++n)
+            (depth * fm[n]).store(m_Matrix[n]);
+        if (routing != m_Routing)
+            selectKernel(routing);
+    }
+
+    /** @return the routing bits of the nonzero entries of a matrix given by rows. */
+    static int routingOf(const simd::float_4 fm[NUM_OPERATORS])
+    {
+        int routing = 0;
+        for (int n = 0; n < NUM_OPERATORS; ++n)
+            routing |= simd::movemask(fm[n] != 0.f) << (n * NUM_OPERATORS);
+        return routing;
+    }
+
+    /** @return the routing bitmask of the kernel in use. */
+    int getKernelRouting() const { return m_KernelRouting; }
+
+    /** Takes effect at the next setMatrix(). */
+    void setFMMode(int mode) { m_FMMode = mode; }
+    int getFMMode() const { return m_FMMode; }
+
+    /**
+     * @param waveforms holds each operator's position from 0 to 3, through sine,
+     * triangle, saw and square. The shapes round it to the nearest Waveform.
+     */
+    void setWaveforms(const float waveforms[NUM_OPERATORS])
+    {
+        for (int op = 0; op < NUM_OPERATORS; ++op)
+        {
+            const float position = clamp(waveforms[op], 0.0f, NUM_WAVEFORMS - 1.0f);
+            m_Waveform[op] = static_cast<int>(std::round(position));
+            m_Frame[op] = std::min(static_cast<int>(position), Wavetable::NUM_FRAMES - 2);
+            m_Morph[op] = position - m_Frame[op];
+        }
+    }
+
+    /** @param table is owned by the caller, and may be null. */
+    void setWavetable(const Wavetable *table) { m_Table = table; }
+
+    void setWaveformMode(int mode) { m_WaveformMode = mode; }
+    int getWaveformMode() const { return m_WaveformMode; }
+
+    void setInterpolation(int interpolation) { m_Interpolation = interpolation; }
+    int getInterpolation() const { return m_Interpolation; }
+
+    /** @param mask has bit n set if operator n is heard or modulates one that is. */
+    void setActiveOperators(int mask)
+    {
+        for (int op = 0; op < NUM_OPERATORS; ++op)
+        {
+            if (!(mask & (1 << op)))
+            {
+                for (int b = 0; b < NUM_BLOCKS; ++b)
+                    out[op][b] = 0.f;
+            }
+        }
+        m_ActiveOperators = mask;
+    }
+
+    /** Moves one lane of an operator to a phase, from 0 to 2^32 for a whole cycle. */
+    void setPhase(int op, int block, int lane, uint32_t phase)
+    {
+        m_Phase[op][block].s[lane] = static_cast<int32_t>(phase);
+        m_ModulatedPhase[op][block].s[lane] = static_cast<int32_t>(phase);
+    }
+
+    /** Silences a block whose voices have all gone idle, so it stops modulating. */
+    void clear(int block)
+    {
+        for (int op = 0; op < NUM_OPERATORS; ++op)
+            out[op][block] = 0.f;
+    }
+
+    /**
+     * Advances BLOCKS blocks of voices by one sample.
+     *
+     * @tparam BLOCKS is 1 for four voices or 2 for eight.
+     * @param blocks holds the BLOCKS blocks to run.
+     */
+    template <int BLOCKS>
+    void process(const int *blocks)
+    {
+        static_assert(BLOCKS == 1 || BLOCKS == 2, "FMOperatorBank runs one or two blocks at a time");
+        (this->*m_Kernels[BLOCKS - 1])(blocks);
+    }
+
+    /** The matrix entry where operator m modulates operator n, as a routing bit. */
+    static constexpr int route(int n, int m) { return 1 << (n * NUM_OPERATORS + m); }
+
+private:
+    typedef void (FMOperatorBank::*Kernel)(const int *);
+
+    struct Topology
+    {
+        int routing;
+        Kernel kernels[2];
+    };
+
+    template <int ROUTING>
+    static Topology topology()
+    {
+        Topology t = {ROUTING, {&FMOperatorBank::kernel<1, ROUTING>, &FMOperatorBank::kernel<2, ROUTING>}};
+        return t;
+    }
+
+    /**
+     * DX-style algorithms, numbering the operators from 0, each with and without
+     * every operator feeding back on itself. The last entry is the generic
+     * kernel.
+     */
+    static const Topology *topologies(int &count)
+    {
+        static const int FEEDBACK = route(0, 0) | route(1, 1) | route(2, 2) | route(3, 3);
+        static const int STACK = route(0, 1) | route(1, 2) | route(2, 3);
+        static const int TWO_STACKS = route(0, 1) | route(2, 3);
+        static const int THREE_TO_ONE = route(0, 1) | route(0, 2) | route(0, 3);
+        static const int ONE_TO_THREE = route(0, 3) | route(1, 3) | route(2, 3);
+        static const int BRANCH = route(0, 1) | route(1, 2) | route(1, 3);
+        static const int STACK_AND_CARRIER = route(0, 1) | route(1, 2);
+        static const int RING = route(0, 1) | route(1, 2) | route(2, 3) | route(3, 0);
+        static const Topology table[] = {
+            topology<0>(),
+            topology<FEEDBACK>(),
+            topology<STACK>(),
+            topology<STACK | FEEDBACK>(),
+            topology<TWO_STACKS>(),
+            topology<TWO_STACKS | FEEDBACK>(),
+            topology<THREE_TO_ONE>(),
+            topology<THREE_TO_ONE | FEEDBACK>(),
+            topology<ONE_TO_THREE>(),
+            topology<ONE_TO_THREE | FEEDBACK>(),
+            topology<BRANCH>(),
+            topology<BRANCH | FEEDBACK>(),
+            topology<STACK_AND_CARRIER>(),
+            topology<STACK_AND_CARRIER | FEEDBACK>(),
+            topology<RING>(),
+            topology<RING | FEEDBACK>(),
+            topology<0xffff>(),
+        };
+        count = sizeof(table) / sizeof(table[0]);
+        return table;
+    }
+
+    /** Picks the topology with the fewest entries that includes every bit of routing. */
+    void selectKernel(int routing)
+    {
+        int count;
+        const Topology *table = topologies(count);
+        const Topology *best = &table[count - 1];
+        for (int i = 0; i < count; ++i)
+        {
+            if ((table[i].routing & routing) == routing && bitCount(table[i].routing) < bitCount(best->routing))
+                best = &table[i];
+        }
+        m_Routing = routing;
+        m_KernelRouting = best->routing;
+        m_Kernels[0] = best->kernels[0];
+        m_Kernels[1] = best->kernels[1];
+    }
+
+    static int bitCount(int x)
+    {
+        int count = 0;
+        for (; x; x &= x - 1)
+            ++count;
+        return count;
+    }
+
+    template <int BLOCKS, int ROUTING>
+    void kernel(const int *blocks)
+    {
+        const bool wavetable = m_WaveformMode == WAVETABLE && m_Table && m_Table->isReady();
+        const bool linear = m_FMMode == LINEAR_THROUGH_ZERO;
+
+        simd::float_4 modulation[NUM_OPERATORS][BLOCKS];
+        for (int n = 0; n < NUM_OPERATORS; ++n)
+        {
+            if (!(ROUTING & row(n)) || !(m_ActiveOperators & (1 << n)))
+                continue;
+            for (int b = 0; b < BLOCKS; ++b)
+            {
+                const int block = blocks[b];
+                simd::float_4 sum = 0.f;
+                if (ROUTING & route(n, 0))
+                    sum += m_Matrix[n][0] * out[0][block];
+                if (ROUTING & route(n, 1))
+                    sum += m_Matrix[n][1] * out[1][block];
+                if (ROUTING & route(n, 2))
+                    sum += m_Matrix[n][2] * out[2][block];
+                if (ROUTING & route(n, 3))
+                    sum += m_Matrix[n][3] * out[3][block];
+                modulation[n][b] = sum;
+            }
+        }
+
+        for (int op = 0; op < NUM_OPERATORS; ++op)
+        {
+            if (!(m_ActiveOperators & (1 << op)))
+                continue;
+            for (int b = 0; b < BLOCKS; ++b)
+            {
+                const int block = blocks[b];
+                if (!simd::movemask(level[op][block] != 0.f))
+                {
+                    out[op][block] = 0.f;
+                    continue;
+                }
+
+                simd::int32_4 modulated;
+                if (!(ROUTING & row(op)))
+                {
+                    m_Phase[op][block] += toFixed(increment[op][block]);
+                    modulated = m_Phase[op][block];
+                }
+                else if (linear)
+                {
+                    const simd::float_4 step = increment[op][block] * (1.0f + modulation[op][b]);
+                    m_Phase[op][block] += toFixed(simd::clamp(step, -0.5f, 0.5f));
+                    modulated = m_Phase[op][block];
+                }
+                else
+                {
+                    m_Phase[op][block] += toFixed(increment[op][block]);
+                    /** Whole cycles of offset are shifted out, so the sum wraps like the phase. */
+                    modulated = m_Phase[op][block] + (simd::int32_4(modulation[op][b] * 16777216.0f) << 8);
+                }
+                const simd::float_4 phase = toFloat(modulated);
+
+                /** How far the modulated phase moved, the shorter way around. The sine doesn't need it. */
+                simd::float_4 dt = 0.f;
+                if (wavetable || m_Waveform[op] != SINE)
+                {
+                    dt = simd::float_4(modulated - m_ModulatedPhase[op][block]) * (1.0f / 4294967296.0f);
+                    dt = simd::clamp(simd::fabs(dt), 1e-6f, 0.5f);
+                    m_ModulatedPhase[op][block] = modulated;
+                }
+
+                const simd::float_4 value = (wavetable) ? lookup(op, phase, dt) : shape(m_Waveform[op], phase, dt, pulseWidth[op][block]);
+                out[op][block] = level[op][block] * value;
+            }
+        }
+    }
+
+    /** Every routing bit of operator n's row. */
+    static constexpr int row(int n) { return 0xf << (n * NUM_OPERATORS); }
+
+    /** A phase increment from -0.5 to 0.5 cycles, in fixed point. */
+    static simd::int32_4 toFixed(simd::float_4 cycles)
+    {
+        return simd::int32_4(cycles * 4294967296.0f);
+    }
+
+    /** A fixed point phase as a float from 0 to 1, from its top 24 bits. */
+    static simd::float_4 toFloat(simd::int32_4 phase)
+    {
+        return simd::float_4((phase >> 8) & simd::int32_4(0xffffff)) * (1.0f / 16777216.0f);
+    }
+
+    /**
+     * Reads an operator's morph position from the wavetable, at each voice's own
+     * mip level. The two frames are blended first, so there is only one
+     * interpolation.
+     */
+    simd::float_4 lookup(int op, simd::float_4 phase, simd::float_4 dt) const
+    {
+        const simd::float_4 position = phase * static_cast<float>(Wavetable::SIZE);
+        const simd::float_4 index = simd::floor(position);
+        const simd::float_4 t = position - index;
+        const int frame = m_Frame[op];
+        const float morph = m_Morph[op];
+        const bool cubic = m_Interpolation == CUBIC;
+        const int numPoints = (cubic) ? 4 : 2;
+        const int first = (cubic) ? -1 : 0;
+
+        simd::float_4 points[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            const int level = Wavetable::levelFor(dt.s[i]);
+            const int j = static_cast<int>(index.s[i]) + first;
+            const float *a = m_Table->get(frame, level);
+            const float *b = m_Table->get(frame + 1, level);
+            if (morph == 0.0f)
+            {
+                for (int k = 0; k < numPoints; ++k)
+                    points[k].s[i] = a[j + k];
+            }
+            else
+            {
+                for (int k = 0; k < numPoints; ++k)
+                    points[k].s[i] = a[j + k] + morph * (b[j + k] - a[j + k]);
+            }
+        }
+
+        if (cubic)
+        {
+            /** Catmull-Rom through the four points. */
+            const simd::float_4 c1 = 0.5f * (points[2] - points[0]);
+            const simd::float_4 c2 = points[0] - 2.5f * points[1] + 2.0f * points[2] - 0.5f * points[3];
+            const simd::float_4 c3 = 0.5f * (points[3] - points[0]) + 1.5f * (points[1] - points[2]);
+            return ((c3 * t + c2) * t + c1) * t + points[1];
+        }
+        return points[0] + t * (points[1] - points[0]);
+    }
+
+    /**
+     * @param phase is from 0 to 1.
+     * @param dt is the phase increment, from 0 to 0.5.
+     * @param pulseWidth is from 0 to 1.
+     */
+    static simd::float_4 shape(int waveform, simd::float_4 phase, simd::float_4 dt, simd::float_4 pulseWidth)
+    {
+        switch (waveform)
+        {
+        case TRIANGLE:
+        {
+            /** Starts at 0 and rises, in phase with the sine. Slope is +-4 per cycle. */
+            simd::float_4 peak = phase - 0.25f;
+            peak -= simd::floor(peak);
+            simd::float_4 trough = phase - 0.75f;
+            trough -= simd::floor(trough);
+            simd::float_4 triangle = 4.0f * simd::fabs(peak - 0.5f) - 1.0f;
+            const simd::float_4 invDt = simd::rcp(dt);
+            return triangle + 8.0f * dt * (PolyBlep::blamp(trough, invDt) - PolyBlep::blamp(peak, invDt));
+        }
+        case SAW:
+            return 2.0f * phase - 1.0f - 2.0f * PolyBlep::blep(phase, simd::rcp(dt));
+        case PULSE:
+        {
+            simd::float_4 fall = phase - pulseWidth;
+            fall -= simd::floor(fall);
+            simd::float_4 pulse = simd::ifelse(phase < pulseWidth, simd::float_4(1.0f), simd::float_4(-1.0f));
+            const simd::float_4 invDt = simd::rcp(dt);
+            return pulse + 2.0f * (PolyBlep::blep(phase, invDt) - PolyBlep::blep(fall, invDt));
+        }
+        default:
+            return TAR::Math::sin2pi(phase);
+        }
+    }
+
+    simd::int32_4 m_Phase[NUM_OPERATORS][NUM_BLOCKS];
+    simd::int32_4 m_ModulatedPhase[NUM_OPERATORS][NUM_BLOCKS];
+    float m_Matrix[NUM_OPERATORS][NUM_OPERATORS];
+    int m_Waveform[NUM_OPERATORS];
+    int m_Frame[NUM_OPERATORS];
+    float m_Morph[NUM_OPERATORS];
+    const Wavetable *m_Table = nullptr;
+    int m_WaveformMode = SHAPES;
+    int m_Interpolation = LINEAR;
+    int m_FMMode = PHASE_MODULATION;
+    int m_ActiveOperators = (1 << NUM_OPERATORS) - 1;
+    int m_Routing = -1;
+    int m_KernelRouting = 0;
+    Kernel m_Kernels[2];
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @class GateScheduler
+ * @brief A preallocated ring of pending gate on/off events, by sample time.
+ *
+ * Events are pushed in time order when a step starts, and process() is called
+ * once per sample with the current sample time. Most samples it does a single
+ * compare against the next pending event. The gate holds its last state between
+ * events.
+ */
+class GateScheduler
+{
+public:
+    static const int CAPACITY = 32; // must be a power of 2
+
+    /** Drops all pending events. The gate keeps its current state. */
+    void clear() { m_Head = m_Tail; }
+
+    /** Drops all pending events and closes the gate. */
+    void reset()
+    {
+        m_Head = m_Tail = 0;
+        m_State = false;
+    }
+
+    bool empty() const { return m_Head == m_Tail; }
+
+    /** Adds an event. Events must be pushed in time order. Returns false when full. */
+    bool push(int64_t time, bool on)
+    {
+        if (m_Tail - m_Head >= CAPACITY)
+            return false;
+        Event &event = m_Events[m_Tail & (CAPACITY - 1)];
+        event.time = time;
+        event.on = on;
+        ++m_Tail;
+        return true;
+    }
+
+    /** Applies every event that is due by now and returns the gate. */
+    bool process(int64_t now)
+    {
+        while (m_Head != m_Tail && m_Events[m_Head & (CAPACITY - 1)].time <= now)
+        {
+            m_State = m_Events[m_Head & (CAPACITY - 1)].on;
+            ++m_Head;
+        }
+        return m_State;
+    }
+
+    bool state() const { return m_State; }
+
+private:
+    struct Event
+    {
+        int64_t time;
+        bool on;
+    };
+
+    Event m_Events[CAPACITY];
+    uint32_t m_Head = 0;
+    uint32_t m_Tail = 0;
+    bool m_State = false;
+};
+
+/**
+ * Spacing curves for ratchets. Speed up starts with wide gaps that get narrower,
+ * slow down is the opposite, and swing delays every second retrigger.
+ */
+enum RatchetCurve
+{
+    RATCHET_EVEN,
+    RATCHET_SPEED_UP,
+    RATCHET_SLOW_DOWN,
+    RATCHET_SWING,
+    NUM_RATCHET_CURVES
+};
+
+static const char *const RATCHET_CURVE_NAMES[NUM_RATCHET_CURVES] = {"Even", "Speed up", "Slow down", "Swing"};
+
+/**
+ * Returns where retrigger index of count lands within its step, from 0 to 1.
+ * Only called when a step starts.
+ */
+inline float ratchetPosition(int curve, int index, int count)
+{
+    const float x = static_cast<float>(index) / count;
+    switch (curve)
+    {
+    case RATCHET_SPEED_UP:
+        return 1.0f - (1.0f - x) * (1.0f - x);
+    case RATCHET_SLOW_DOWN:
+        return x * x;
+    case RATCHET_SWING:
+        return (index % 2 && index < count) ? x + 1.0f / (3.0f * count) : x;
+    default:
+        return x;
+    }
+}
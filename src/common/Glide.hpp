@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../plugin.hpp"
+
+/**
+ * @class GlideEngine
+ * @brief Portamento for four voices that lands exactly on each new note.
+ *
+ * A glide is planned once, when a voice's target changes: its length in
+ * samples and the per-sample increment that covers the interval in exactly
+ * that many samples. After that each sample is one add per voice and a
+ * countdown, and the last sample snaps to the target so rounding never leaves
+ * the output a hair off pitch. Once every voice has landed, process() does no
+ * work at all.
+ *
+ * Glide time is either constant, the same for any interval, or a rate, in time
+ * per octave. It is absolute, in seconds, or synced, as a fraction of the
+ * step length. With legato only set, the sequencer's step events decide
+ * whether a note glides in or jumps.
+ */
+class GlideEngine
+{
+public:
+    enum Mode
+    {
+        CONSTANT_TIME,
+        CONSTANT_RATE,
+        NUM_MODES
+    };
+
+    GlideEngine() { reset(); }
+
+    void reset()
+    {
+        m_Out = 0.f;
+        m_Target = 0.f;
+        m_Increment = 0.f;
+        m_VoiceRemaining = 0.f;
+        m_Remaining = 0;
+    }
+
+    void setMode(int mode) { m_Mode = mode; }
+    int getMode() const { return m_Mode; }
+
+    void setSync(bool sync) { m_Sync = sync; }
+    bool getSync() const { return m_Sync; }
+
+    void setLegatoOnly(bool legatoOnly) { m_LegatoOnly = legatoOnly; }
+    bool getLegatoOnly() const { return m_LegatoOnly; }
+
+    /**
+     * @param time is in seconds, or in steps when synced. With a constant rate
+     * it is per octave.
+     * @param sampleTime is the engine sample time.
+     */
+    void setTime(float time, float sampleTime)
+    {
+        m_Time = time;
+        m_SampleTime = sampleTime;
+    }
+
+    /**
+     * Called at step events.
+     *
+     * @param stepSamples is the length of the new step in samples.
+     * @param legato is whether the new step continues a phrase, and so may glide in.
+     */
+    void beginStep(int stepSamples, bool legato)
+    {
+        m_StepSamples = stepSamples;
+        m_Legato = legato;
+    }
+
+    simd::float_4 process(simd::float_4 target)
+    {
+        const int changed = simd::movemask(target != m_Target);
+        if (changed)
+            plan(target, changed);
+
+        if (m_Remaining > 0)
+        {
+            m_Out += m_Increment;
+            m_VoiceRemaining -= 1.0f;
+            m_Out = simd::ifelse(m_VoiceRemaining <= 0.0f, m_Target, m_Out);
+            --m_Remaining;
+        }
+        return m_Out;
+    }
+
+private:
+    /** Works out the glides of the voices whose targets changed. */
+    void plan(simd::float_4 target, int changed)
+    {
+        const float length = (m_Sync) ? m_Time * m_StepSamples : m_Time / m_SampleTime;
+        const bool glide = length >= 1.0f && (!m_LegatoOnly || m_Legato);
+
+        m_Remaining = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (changed & (1 << i))
+            {
+                const float interval = target.s[i] - m_Out.s[i];
+                float samples = (m_Mode == CONSTANT_RATE) ? length * std::fabs(interval) : length;
+                samples = std::round(samples);
+                m_Target.s[i] = target.s[i];
+
+                if (glide && samples >= 1.0f)
+                {
+                    m_Increment.s[i] = interval / samples;
+                    m_VoiceRemaining.s[i] = samples;
+                }
+                else
+                {
+                    m_Out.s[i] = target.s[i];
+                    m_Increment.s[i] = 0.0f;
+                    m_VoiceRemaining.s[i] = 0.0f;
+                }
+            }
+            m_Remaining = std::max(m_Remaining, static_cast<int>(m_VoiceRemaining.s[i]));
+        }
+    }
+
+    simd::float_4 m_Out;
+    simd::float_4 m_Target;
+    simd::float_4 m_Increment;
+    simd::float_4 m_VoiceRemaining;
+    int m_Remaining;
+
+    int m_Mode = CONSTANT_TIME;
+    bool m_Sync = false;
+    bool m_LegatoOnly = false;
+    bool m_Legato = true;
+    float m_Time = 0.0f;
+    float m_SampleTime = 1.0f / 44100.0f;
+    int m_StepSamples = 1;
+};
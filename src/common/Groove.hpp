@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+
+/**
+ * @struct GrooveTemplate
+ * @brief MPC style per-step timing offsets and gate lengths.
+ *
+ * Offsets are fractions of a step, negative for early and positive for late.
+ * Gate lengths are fractions of a step. The template repeats every length steps.
+ */
+struct GrooveTemplate
+{
+    static const int MAX_STEPS = 16;
+    static constexpr float MIN_OFFSET = -0.5f;
+    static constexpr float MAX_OFFSET = 0.5f;
+
+    char name[24];
+    int length;
+    float offset[MAX_STEPS];
+    float gateLength[MAX_STEPS];
+};
+
+/**
+ * Built-in grooves. The first one is straight time with half-step gates, which is
+ * what the sequencer did before grooves existed. The swing percentages are where
+ * the second 16th lands within each 8th, as on the MPC.
+ */
+static const GrooveTemplate BUILT_IN_GROOVES[] = {
+    {"Off", 1, {0.0f}, {0.5f}},
+    {"Swing 54%", 2, {0.0f, 0.08f}, {0.5f, 0.5f}},
+    {"Swing 58%", 2, {0.0f, 0.16f}, {0.5f, 0.5f}},
+    {"Swing 62%", 2, {0.0f, 0.24f}, {0.5f, 0.5f}},
+    {"Swing 66%", 2, {0.0f, 0.32f}, {0.55f, 0.45f}},
+    {"Swing 71%", 2, {0.0f, 0.42f}, {0.6f, 0.4f}},
+    {"Shuffle", 4, {0.0f, 0.2f, 0.0f, 0.25f}, {0.7f, 0.3f, 0.6f, 0.3f}},
+    {"Laid back", 4, {0.0f, 0.06f, 0.03f, 0.1f}, {0.6f, 0.45f, 0.55f, 0.4f}},
+    {"Push", 4, {0.0f, -0.05f, -0.02f, -0.08f}, {0.5f, 0.4f, 0.5f, 0.35f}},
+    {"Staccato", 1, {0.0f}, {0.15f}},
+    {"Legato", 1, {0.0f}, {0.95f}},
+};
+static const int NUM_BUILT_IN_GROOVES = sizeof(BUILT_IN_GROOVES) / sizeof(GrooveTemplate);
+
+/**
+ * @struct GrooveTable
+ * @brief A groove template baked down to sample counts for one tempo.
+ *
+ * For the internal clock, every step has a length and a gate length in samples, so
+ * the per-sample work is a counter and two integer compares. The cumulative step
+ * starts are rounded rather than the individual lengths, so rounding never adds up
+ * over a cycle.
+ *
+ * An external clock can't be anticipated, so for it the offsets are shifted to be
+ * non-negative and are applied as a delay after each clock edge, scaled by the
+ * measured clock period.
+ *
+ * No offset may land more than MAX_OFFSET_SPAN after the earliest one. That keeps
+ * every step at least a tenth of a step long, so the cycle length and the tempo
+ * never change, and keeps every delay inside one clock period, so a delayed step
+ * always fires before the next clock edge.
+ */
+struct GrooveTable
+{
+    static const int MAX_STEPS = GrooveTemplate::MAX_STEPS * 2;
+    static constexpr float MAX_OFFSET_SPAN = 0.9f;
+
+    int length = 1;
+    int stepSamples[MAX_STEPS] = {};
+    int gateSamples[MAX_STEPS] = {};
+    float delay[MAX_STEPS] = {};
+    float gateLength[MAX_STEPS] = {};
+
+    /**
+     * @param groove is the groove template.
+     * @param swingOffset is added to the offset of every odd step.
+     * @param samplesPerStep is the unswung step length for the current tempo.
+     */
+    void build(const GrooveTemplate &groove, float swingOffset, float samplesPerStep)
+    {
+        length = groove.length;
+        if (swingOffset != 0.0f && length % 2)
+            length *= 2;
+
+        float offsets[MAX_STEPS];
+        float minOffset = 0.0f;
+        for (int i = 0; i < length; ++i)
+        {
+            offsets[i] = groove.offset[i % groove.length] + ((i % 2) ? swingOffset : 0.0f);
+            gateLength[i] = groove.gateLength[i % groove.length];
+            minOffset = std::fmin(minOffset, offsets[i]);
+        }
+        for (int i = 0; i < length; ++i)
+            offsets[i] = std::fmin(offsets[i], minOffset + MAX_OFFSET_SPAN);
+
+        int start = static_cast<int>(std::round(offsets[0] * samplesPerStep));
+        for (int i = 0; i < length; ++i)
+        {
+            float nextOffset = (i + 1 < length) ? offsets[i + 1] : offsets[0];
+            int nextStart = static_cast<int>(std::round((i + 1 + nextOffset) * samplesPerStep));
+            stepSamples[i] = (nextStart - start > 1) ? nextStart - start : 1;
+            start = nextStart;
+
+            int gate = static_cast<int>(std::round(gateLength[i] * samplesPerStep));
+            gateSamples[i] = (gate < stepSamples[i]) ? gate : stepSamples[i] - 1;
+            delay[i] = offsets[i] - minOffset;
+        }
+    }
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../plugin.hpp"
+#include "REMath.hpp"
+
+/**
+ * @class SineLFOBank
+ * @brief Four sine LFOs, one per voice, running together in one simd::float_4.
+ *
+ * The phase increments are only recomputed when the rate, sample time or
+ * decorrelation changes, so the per-sample work is an add, a wrap and a
+ * polynomial sine for all four voices at once.
+ *
+ * Phase spread offsets the voices evenly across a quarter cycle each at full
+ * spread. Decorrelation detunes each voice by a small, fixed and unrelated
+ * amount, so they drift apart instead of moving in lockstep.
+ */
+class SineLFOBank
+{
+public:
+    SineLFOBank() { reset(); }
+
+    void reset()
+    {
+        m_Phase = 0.f;
+        m_Offset = 0.f;
+        m_Increment = 0.f;
+        m_Pitch = m_PitchAttenuation = m_SampleTime = m_Decorrelation = -1.0f;
+    }
+
+    /**
+     * @param pitch is the rate, in octaves. The LFO runs at 0.5 Hz * 2^(pitch * pitchAttenuation).
+     * @param pitchAttenuation scales the pitch.
+     * @param sampleTime is the engine sample time.
+     * @param decorrelation is from 0 to 1.
+     */
+    void setRate(float pitch, float pitchAttenuation, float sampleTime, float decorrelation)
+    {
+        if (pitch == m_Pitch && pitchAttenuation == m_PitchAttenuation && sampleTime == m_SampleTime &&
+            decorrelation == m_Decorrelation)
+            return;
+
+        m_Pitch = pitch;
+        m_PitchAttenuation = pitchAttenuation;
+        m_SampleTime = sampleTime;
+        m_Decorrelation = decorrelation;
+
+        static const simd::float_4 rateOffsets(0.0f, 0.0377f, -0.0293f, 0.0611f);
+        float increment = 0.5f * TAR::Math::fastExp2(pitch * pitchAttenuation) * sampleTime;
+        m_Increment = increment * (1.0f + decorrelation * rateOffsets);
+    }
+
+    /** @param spread is from 0 to 1. */
+    void setSpread(float spread)
+    {
+        static const simd::float_4 spreadOffsets(0.0f, 0.25f, 0.5f, 0.75f);
+        m_Offset = spread * spreadOffsets;
+    }
+
+    /** Advances all four LFOs by one sample and returns them, from -1 to 1. */
+    simd::float_4 process()
+    {
+        m_Phase += m_Increment;
+        m_Phase -= simd::floor(m_Phase);
+        return TAR::Math::sin2pi(m_Phase + m_Offset);
+    }
+
+private:
+    simd::float_4 m_Phase;
+    simd::float_4 m_Offset;
+    simd::float_4 m_Increment;
+    float m_Pitch;
+    float m_PitchAttenuation;
+    float m_SampleTime;
+    float m_Decorrelation;
+};
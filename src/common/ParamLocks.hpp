@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @struct ParamLocks
+ * @brief Sparse per-step parameter overrides, Elektron style.
+ *
+ * Each step has a bitmask of which parameters it locks. The locked values are
+ * packed into one array, step by step and lock by lock, so a pattern with no
+ * locks stores nothing but the masks. start[step] is the index of the step's first
+ * value, and the rest are found by counting the mask bits below the lock.
+ *
+ * Locks are looked up once per step event, never per sample.
+ */
+struct ParamLocks
+{
+    enum Lock
+    {
+        SLIDE,
+        DETUNE_AMOUNT,
+        GATE_PROBABILITY,
+        GATE_LENGTH,
+        NUM_LOCKS
+    };
+
+    static const int NUM_STEPS = 32;
+
+    uint8_t mask[NUM_STEPS] = {};
+    uint8_t start[NUM_STEPS + 1] = {};
+    float values[NUM_STEPS * NUM_LOCKS] = {};
+    int count = 0;
+
+    bool any() const { return count > 0; }
+
+    bool has(int step, int lock) const { return mask[step] & (1 << lock); }
+
+    /** Only valid if has(step, lock). */
+    float get(int step, int lock) const
+    {
+        return values[start[step] + __builtin_popcount(mask[step] & ((1 << lock) - 1))];
+    }
+
+    /** Adds or changes a lock. */
+    void set(int step, int lock, float value)
+    {
+        const uint8_t bit = 1 << lock;
+        const int index = start[step] + __builtin_popcount(mask[step] & (bit - 1));
+        if (!(mask[step] & bit))
+        {
+            for (int i = count; i > index; --i)
+                values[i] = values[i - 1];
+            mask[step] |= bit;
+            ++count;
+            for (int s = step + 1; s <= NUM_STEPS; ++s)
+                ++start[s];
+        }
+        values[index] = value;
+    }
+
+    void clear(int step, int lock)
+    {
+        const uint8_t bit = 1 << lock;
+        if (!(mask[step] & bit))
+            return;
+
+        const int index = start[step] + __builtin_popcount(mask[step] & (bit - 1));
+        for (int i = index; i < count - 1; ++i)
+            values[i] = values[i + 1];
+        mask[step] &= ~bit;
+        --count;
+        for (int s = step + 1; s <= NUM_STEPS; ++s)
+            --start[s];
+    }
+
+    void clearStep(int step)
+    {
+        for (int lock = 0; lock < NUM_LOCKS; ++lock)
+            clear(step, lock);
+    }
+
+    void clearAll()
+    {
+        for (int step = 0; step < NUM_STEPS; ++step)
+            mask[step] = 0;
+        for (int step = 0; step <= NUM_STEPS; ++step)
+            start[step] = 0;
+        count = 0;
+    }
+};
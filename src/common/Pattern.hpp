@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+/**
+ * @struct PatternRecord
+ * @brief A fixed-size, plain-old-data copy of one SemitoneSequencer pattern.
+ *
+ * This is the record stored in pattern library files, so its layout must not
+ * change without bumping the library file version. All 32 steps are stored, four
+ * measures of eight steps each, whether or not they are used.
+ */
+struct PatternRecord
+{
+    static const int NUM_STEPS = 32;
+
+    int8_t octave[NUM_STEPS];    // -4 - 4
+    uint8_t semitone[NUM_STEPS]; // 0 - 11
+    uint32_t activeMask;         // bit n set when step n is active
+    uint8_t numStepsPerMeasure;  // 1 - 8, 0 to leave the current setting alone
+    uint8_t numMeasures;         // 1 - 4, 0 to leave the current setting alone
+    uint8_t reserved[2];
+
+    /** Fills the record from the sequencer's per-step value arrays. */
+    void fromArrays(const float *octaves, const float *semitones, const float *stepActive)
+    {
+        activeMask = 0;
+        for (int i = 0; i < NUM_STEPS; ++i)
+        {
+            octave[i] = static_cast<int8_t>(std::round(octaves[i]));
+            semitone[i] = static_cast<uint8_t>(std::round(semitones[i]));
+            if (stepActive[i] > 0.0f)
+                activeMask |= (1u << i);
+        }
+        reserved[0] = reserved[1] = 0;
+    }
+
+    /** Writes the record into the sequencer's per-step value arrays. */
+    void toArrays(float *octaves, float *semitones, float *stepActive) const
+    {
+        for (int i = 0; i < NUM_STEPS; ++i)
+        {
+            octaves[i] = octave[i];
+            semitones[i] = semitone[i];
+            stepActive[i] = (activeMask >> i) & 1u;
+        }
+    }
+};
+
+static_assert(sizeof(PatternRecord) == 72, "PatternRecord is a file format, keep it packed");
+
+/**
+ * @struct PatternSnapshot
+ * @brief What the pattern overview display needs: the pattern and the playhead.
+ */
+struct PatternSnapshot
+{
+    PatternRecord pattern;
+    int8_t step;
+    uint8_t running;
+    uint8_t reserved[2];
+};
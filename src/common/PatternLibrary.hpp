@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+
+#if defined ARCH_WIN
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Pattern.hpp"
+
+/**
+ * @class PatternLibrary
+ * @brief A read-only, memory-mapped file of PatternRecords.
+ *
+ * File layout, little endian:
+ *
+ *     offset 0   char[4]   magic, "REPL"
+ *     offset 4   uint32    version, currently 1
+ *     offset 8   uint32    record size in bytes, sizeof(PatternRecord)
+ *     offset 12  uint32    number of records
+ *     offset 16  PatternRecord[number of records]
+ *
+ * Libraries are opened through acquire(), which maps each file once per process
+ * and hands the same mapping to every module that asks for it. The mapping is
+ * released when the last module lets go of it, and replaced by a fresh one once
+ * the file's size or modification time changes. Every page is faulted in when
+ * the file is mapped, so looking up a record is a bounds clamp and a pointer
+ * offset, and is safe to do on the audio thread.
+ */
+class PatternLibrary
+{
+public:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t numRecords;
+    };
+
+    static const uint32_t VERSION = 1;
+
+    ~PatternLibrary()
+    {
+#if defined ARCH_WIN
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+#else
+        if (m_Data)
+            munmap(const_cast<uint8_t *>(m_Data), m_Size);
+#endif
+    }
+
+    /**
+     * Returns the shared mapping of the library at path, mapping it if no other
+     * module has it open or if the file has changed since it was mapped. Returns
+     * null if the file can't be mapped or isn't a valid library. Must not be
+     * called from the audio thread.
+     */
+    static std::shared_ptr<const PatternLibrary> acquire(const std::string &path)
+    {
+        static std::mutex mutex;
+        static std::map<std::string, std::weak_ptr<const PatternLibrary>> cache;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<const PatternLibrary> library = cache[path].lock();
+        if (library && !library->isStale())
+            return library;
+
+        std::shared_ptr<PatternLibrary> newLibrary(new PatternLibrary);
+        if (!newLibrary->map(path))
+            return nullptr;
+
+        cache[path] = newLibrary;
+        return newLibrary;
+    }
+
+    /**
+     * Appends a record to the library at path, creating the file if needed.
+     * Modules that already have the file mapped keep seeing the records that
+     * were there when they mapped it, until they acquire it again.
+     */
+    static bool append(const std::string &path, const PatternRecord &record)
+    {
+        FILE *file = std::fopen(path.c_str(), "r+b");
+        Header header;
+        if (file)
+        {
+            if (std::fread(&header, sizeof(header), 1, file) != 1 || !isValid(header))
+            {
+                std::fclose(file);
+                return false;
+            }
+        }
+        else
+        {
+            file = std::fopen(path.c_str(), "w+b");
+            if (!file)
+                return false;
+            std::memcpy(header.magic, "REPL", 4);
+            header.version = VERSION;
+            header.recordSize = sizeof(PatternRecord);
+            header.numRecords = 0;
+        }
+
+        long offset = sizeof(Header) + static_cast<long>(header.numRecords) * sizeof(PatternRecord);
+        bool ok = std::fseek(file, offset, SEEK_SET) == 0 &&
+                  std::fwrite(&record, sizeof(record), 1, file) == 1;
+        if (ok)
+        {
+            ++header.numRecords;
+            ok = std::fseek(file, 0, SEEK_SET) == 0 &&
+                 std::fwrite(&header, sizeof(header), 1, file) == 1;
+        }
+        std::fclose(file);
+        return ok;
+    }
+
+    uint32_t size() const { return m_NumRecords; }
+    const std::string &path() const { return m_Path; }
+
+    /** Returns the record at index, clamped to the library. Never null. */
+    const PatternRecord *get(int index) const
+    {
+        if (index < 0)
+            index = 0;
+        if (index >= static_cast<int>(m_NumRecords))
+            index = m_NumRecords - 1;
+        return m_Records + index;
+    }
+
+    /** Maps a 0 - 10V select voltage onto the whole library. */
+    const PatternRecord *select(float voltage) const
+    {
+        return get(static_cast<int>(voltage * 0.1f * m_NumRecords));
+    }
+
+private:
+    PatternLibrary() = default;
+    PatternLibrary(const PatternLibrary &) = delete;
+    PatternLibrary &operator=(const PatternLibrary &) = delete;
+
+    /** Whether the file has changed since it was mapped. */
+    bool isStale() const
+    {
+        struct stat st;
+        return stat(m_Path.c_str(), &st) != 0 ||
+               static_cast<size_t>(st.st_size) != m_Size ||
+               st.st_mtime != m_ModifiedTime;
+    }
+
+    static bool isValid(const Header &header)
+    {
+        return std::memcmp(header.magic, "REPL", 4) == 0 &&
+               header.version == VERSION &&
+               header.recordSize == sizeof(PatternRecord);
+    }
+
+    bool map(const std::string &path)
+    {
+        m_Path = path;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        m_ModifiedTime = st.st_mtime;
+#if defined ARCH_WIN
+        m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_File, &fileSize))
+            return false;
+        m_Size = static_cast<size_t>(fileSize.QuadPart);
+        if (m_Size < sizeof(Header))
+            return false;
+        m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!m_Mapping)
+            return false;
+        m_Data = static_cast<const uint8_t *>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_Data)
+            return false;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        {
+            close(fd);
+            return false;
+        }
+        m_Size = st.st_size;
+        int flags = MAP_SHARED;
+#if defined MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void *data = mmap(NULL, m_Size, PROT_READ, flags, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        madvise(data, m_Size, MADV_WILLNEED);
+        m_Data = static_cast<const uint8_t *>(data);
+#endif
+
+        /**
+         * Reads a byte of every page here on the loader thread, so the audio
+         * thread never waits on the disk. MAP_POPULATE already does this on Linux.
+         */
+        volatile uint8_t touched = 0;
+        for (size_t offset = 0; offset < m_Size; offset += PAGE_STRIDE)
+            touched ^= m_Data[offset];
+        touched ^= m_Data[m_Size - 1];
+
+        Header header;
+        std::memcpy(&header, m_Data, sizeof(header));
+        if (!isValid(header) || header.numRecords == 0)
+            return false;
+
+        /** Only trust as many records as were mapped. */
+        size_t available = (m_Size - sizeof(Header)) / sizeof(PatternRecord);
+        m_NumRecords = (header.numRecords < available) ? header.numRecords : static_cast<uint32_t>(available);
+        m_Records = reinterpret_cast<const PatternRecord *>(m_Data + sizeof(Header));
+        return m_NumRecords > 0;
+    }
+
+    /** The smallest page size of any platform Rack runs on. */
+    static const size_t PAGE_STRIDE = 4096;
+
+    std::string m_Path;
+    const uint8_t *m_Data = nullptr;
+    size_t m_Size = 0;
+    time_t m_ModifiedTime = 0;
+    const PatternRecord *m_Records = nullptr;
+    uint32_t m_NumRecords = 0;
+#if defined ARCH_WIN
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = NULL;
+#endif
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../plugin.hpp"
+#include "Pattern.hpp"
+#include "Seqlock.hpp"
+
+/**
+ * @struct PatternOverviewDrawer
+ * @brief Draws every step of every measure: a bar for the pitch of each active
+ * step, an outline for each inactive one, and a highlight on the playhead.
+ *
+ * This only runs when the framebuffer around it is dirty.
+ */
+struct PatternOverviewDrawer : widget::TransparentWidget
+{
+    PatternSnapshot snapshot = {};
+
+    void draw(const DrawArgs &args) override
+    {
+        nvgBeginPath(args.vg);
+        nvgRoundedRect(args.vg, 0.0f, 0.0f, box.size.x, box.size.y, 2.0f);
+        nvgFillColor(args.vg, nvgRGB(0x12, 0x12, 0x12));
+        nvgFill(args.vg);
+
+        const PatternRecord &pattern = snapshot.pattern;
+        const int numSteps = clamp((int)pattern.numStepsPerMeasure, 1, 8);
+        const int numMeasures = clamp((int)pattern.numMeasures, 1, 4);
+        const float cellWidth = box.size.x / 8.0f;
+        const float cellHeight = box.size.y / 4.0f;
+        const float margin = 1.0f;
+
+        for (int measure = 0; measure < numMeasures; ++measure)
+        {
+            for (int step = 0; step < numSteps; ++step)
+            {
+                const int index = measure * 8 + step;
+                const float x = step * cellWidth + margin;
+                const float y = measure * cellHeight + margin;
+                const float w = cellWidth - 2.0f * margin;
+                const float h = cellHeight - 2.0f * margin;
+
+                if (snapshot.running && index == snapshot.step)
+                {
+                    nvgBeginPath(args.vg);
+                    nvgRect(args.vg, x, y, w, h);
+                    nvgFillColor(args.vg, nvgRGB(0x30, 0x40, 0x60));
+                    nvgFill(args.vg);
+                }
+
+                if (!((pattern.activeMask >> index) & 1u))
+                {
+                    nvgBeginPath(args.vg);
+                    nvgRect(args.vg, x, y, w, h);
+                    nvgStrokeColor(args.vg, nvgRGB(0x40, 0x40, 0x40));
+                    nvgStrokeWidth(args.vg, 0.5f);
+                    nvgStroke(args.vg);
+                    continue;
+                }
+
+                /** Pitch from -4V to 4V + 11 semitones, bottom to top. */
+                const float pitch = ((pattern.octave[index] + 4) * 12 + pattern.semitone[index]) / 107.0f;
+                const float barHeight = std::fmax(h * clamp(pitch, 0.0f, 1.0f), 1.0f);
+                nvgBeginPath(args.vg);
+                nvgRect(args.vg, x, y + h - barHeight, w, barHeight);
+                nvgFillColor(args.vg, nvgRGB(0xd0, 0xe0, 0xff));
+                nvgFill(args.vg);
+            }
+        }
+    }
+};
+
+/**
+ * @struct PatternOverview
+ * @brief A cached display of the whole pattern.
+ *
+ * The engine publishes a PatternSnapshot through a Seqlock. Each UI frame this
+ * compares the seqlock's version with the last one it drew, which is a single
+ * atomic load when nothing has changed. Only a new version is copied out, and
+ * only then is the framebuffer redrawn.
+ */
+struct PatternOverview : widget::Widget
+{
+    const Seqlock<PatternSnapshot> *source = nullptr;
+    widget::FramebufferWidget *framebuffer;
+    PatternOverviewDrawer *drawer;
+    uint32_t drawnVersion = 0;
+
+    PatternOverview()
+    {
+        framebuffer = new widget::FramebufferWidget;
+        addChild(framebuffer);
+        drawer = new PatternOverviewDrawer;
+        framebuffer->addChild(drawer);
+    }
+
+    /** Call after setting box.size. source is null in the module browser. */
+    void setSource(const Seqlock<PatternSnapshot> *source)
+    {
+        this->source = source;
+        framebuffer->box.size = box.size;
+        drawer->box.size = box.size;
+        if (!source)
+        {
+            /** An example pattern for the module browser. */
+            PatternRecord &pattern = drawer->snapshot.pattern;
+            pattern.numStepsPerMeasure = 8;
+            pattern.numMeasures = 4;
+            pattern.activeMask = 0xffffffffu;
+            for (int i = 0; i < PatternRecord::NUM_STEPS; ++i)
+                pattern.semitone[i] = (i * 5) % 12;
+        }
+        framebuffer->setDirty();
+    }
+
+    void step() override
+    {
+        if (source && source->version() != drawnVersion)
+        {
+            PatternSnapshot snapshot;
+            uint32_t version;
+            if (source->read(snapshot, version))
+            {
+                drawer->snapshot = snapshot;
+                drawnVersion = version;
+                framebuffer->setDirty();
+            }
+        }
+        Widget::step();
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../plugin.hpp"
+
+/**
+ * Polynomial band-limited step (PolyBLEP) and ramp (PolyBLAMP) residuals.
+ *
+ * Both take a phase from 0 to 1 with the discontinuity at 0, and the reciprocal
+ * of the phase increment per sample, so a waveform with several corrections
+ * divides once. They are branch-free, so they work the same on float and on
+ * simd::float_4 with a different discontinuity in each lane.
+ *
+ * The sample before and the sample after a discontinuity are the same
+ * polynomial mirrored, so both sides come from one signed distance in samples,
+ * which costs a few multiplies and a select.
+ */
+namespace PolyBlep
+{
+
+/** Signed distance from the discontinuity, in samples. */
+template <typename T>
+T distance(T t, T invDt)
+{
+    return simd::ifelse(t < 0.5f, t, t - 1.0f) * invDt;
+}
+
+/**
+ * The residual of a unit step at phase 0, spread over the sample on either
+ * side. Add it, scaled by the jump, to the naive waveform.
+ *
+ * @param invDt is 1 / the phase increment, which is from 0 to 0.5.
+ */
+template <typename T>
+T blep(T t, T invDt)
+{
+    const T u = distance(t, invDt);
+    const T v = simd::fmax(1.0f - simd::fabs(u), T(0.0f));
+    return simd::ifelse(u < 0.0f, 0.5f * v * v, -0.5f * v * v);
+}
+
+/**
+ * The residual of a unit change in slope, per sample, at phase 0. Add it, scaled
+ * by the change in slope per unit of phase times the phase increment, to the
+ * naive waveform.
+ *
+ * @param invDt is 1 / the phase increment, which is from 0 to 0.5.
+ */
+template <typename T>
+T blamp(T t, T invDt)
+{
+    const T u = distance(t, invDt);
+    const T v = simd::fmax(1.0f - simd::fabs(u), T(0.0f));
+    return (1.0f / 6.0f) * v * v * v;
+}
+
+} // namespace PolyBlep
@@ -3,6 +3,7 @@
 #define TARMATH_H
 
 #include <math.h>
+#include <string.h>
 #include <rack.hpp>
 
 namespace TAR
@@ -208,6 +209,68 @@ inline float dryWetCrossfade(float dry, float wet, float mixParam)
     return (dry * dryMultiplier + wet * wetMultiplier);
 }
 
+/**
+ * @brief Polynomial approximation of sin(2 pi x), for a phase x in cycles.
+ * 
+ * The phase is wrapped to [-0.5, 0.5] and folded into [-0.25, 0.25], where a \n
+ * 9th order odd polynomial stays within 4e-6 of the true sine. There are no \n
+ * branches, so it runs the same on floats and on simd::float_4.
+ * 
+ * @tparam T float or simd::float_4.
+ * @param x The phase, in cycles. Any value.
+ * @return T The sine of the phase.
+ */
+template <typename T>
+T sin2pi(T x)
+{
+    x -= rack::simd::round(x);
+    x = rack::simd::ifelse(x > 0.25f, 0.5f - x, x);
+    x = rack::simd::ifelse(x < -0.25f, -0.5f - x, x);
+    T x2 = x * x;
+    return x * (6.2831853f + x2 * (-41.341702f + x2 * (81.605249f + x2 * (-76.705859f + x2 * 42.058694f))));
+}
+
+/**
+ * @brief 2^x for x from 0 to 1, as a 4th order polynomial.
+ * 
+ * The coefficients are fitted for the least worst relative error, 3.4e-6, with \n
+ * the ends pinned to exactly 1 and 2 so that neighbouring octaves meet.
+ */
+template <typename T>
+T exp2Fraction(T x)
+{
+    return 1.0f + x * (0.69303212f + x * (0.24137976f + x * (0.052032369f + x * 0.013555747f)));
+}
+
+/**
+ * @brief Fast 2^x, for turning volts per octave into frequencies.
+ * 
+ * Whole octaves go straight into the exponent bits and the fraction goes \n
+ * through exp2Fraction(). Within 0.006 cents of std::exp2 everywhere, and \n
+ * exact on whole octaves. x is clamped to +-126.
+ * 
+ * @param x The exponent, in octaves.
+ * @return float 2^x.
+ */
+inline float fastExp2(float x)
+{
+    x = std::min(std::max(x, -126.0f), 126.0f);
+    const float whole = std::floor(x);
+    const int32_t bits = (static_cast<int32_t>(whole) + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale * exp2Fraction(x - whole);
+}
+
+/** @brief fastExp2() on four values at once. */
+inline rack::simd::float_4 fastExp2(rack::simd::float_4 x)
+{
+    x = rack::simd::clamp(x, -126.0f, 126.0f);
+    const rack::simd::float_4 whole = rack::simd::floor(x);
+    const rack::simd::float_4 scale = rack::simd::float_4::cast((rack::simd::int32_4(whole) + 127) << 23);
+    return scale * exp2Fraction(x - whole);
+}
+
 template <typename T>
 T sign(T x)
 {
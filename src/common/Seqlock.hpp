@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @class Seqlock
+ * @brief Publishes a plain-old-data value from one writer to any number of readers
+ * without locking either side.
+ *
+ * The sequence number is odd while a write is in progress. A reader copies the
+ * value and keeps the copy only if the sequence was even and unchanged across the
+ * copy. Readers can also compare version() against the last version they read,
+ * which skips the copy entirely when nothing has been published since.
+ */
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock values must be trivially copyable");
+
+public:
+    Seqlock() { std::memset(&m_Value, 0, sizeof(T)); }
+
+    /** Called from the writer thread only. */
+    void publish(const T &value)
+    {
+        const uint32_t sequence = m_Sequence.load(std::memory_order_relaxed);
+        m_Sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&m_Value, &value, sizeof(T));
+        m_Sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /** Returns false if a write was in progress. Try again on the next frame. */
+    bool read(T &value, uint32_t &version) const
+    {
+        const uint32_t before = m_Sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+        std::memcpy(&value, &m_Value, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_Sequence.load(std::memory_order_relaxed) != before)
+            return false;
+        version = before;
+        return true;
+    }
+
+    uint32_t version() const { return m_Sequence.load(std::memory_order_acquire); }
+
+private:
+    T m_Value;
+    std::atomic<uint32_t> m_Sequence{0};
+};
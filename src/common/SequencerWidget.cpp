@@ -6,7 +6,7 @@ struct NumStepsPerMeasureItem : rack::ui::MenuItem
     int numSteps;
     void onAction(const event::Action &event) override
     {
-        module->numStepsPerMeasure = numSteps + 1;
+        module->sendCommand(SequencerCommand::SET_STEPS_PER_MEASURE, numSteps);
     }
 };
 
@@ -57,7 +57,7 @@ struct NumMeasuresItem : ui::MenuItem
     int numMeasures;
     void onAction(const event::Action &event) override
     {
-        module->numMeasures = numMeasures;
+        module->sendCommand(SequencerCommand::SET_NUM_MEASURES, numMeasures);
     }
 };
 
@@ -106,7 +106,7 @@ struct ChordModeItem : ui::MenuItem
     int chordMode;
     void onAction(const event::Action &event) override
     {
-        module->chordMode = chordMode;
+        module->sendCommand(SequencerCommand::SET_CHORD_MODE, chordMode);
     }
 };
 
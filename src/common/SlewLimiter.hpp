@@ -1,49 +1,161 @@
 #pragma once
 
-#include "plugin.hpp"
+#include <cmath>
+#include "../plugin.hpp"
 
-class SlewLimiter
+/**
+ * @class TSlewLimiter
+ * @brief A slew limiter with separate rise and fall times and three curves, for
+ * one voice (float) or four (simd::float_4).
+ *
+ * Every coefficient is worked out in setTimes(), and only when a time or the
+ * sample time changes, so process() has no transcendentals, and no divisions
+ * except in the classic curve.
+ * The coefficients are scalar floats shared by all voices and process() only
+ * adds, multiplies, compares and selects, so a float and a float_4 limiter give
+ * the same output bit for bit.
+ *
+ * Curves:
+ *  - Linear moves at a constant rate.
+ *  - Log moves fast at first and eases into the target, like an RC circuit.
+ *  - Exponential starts slowly and speeds up until it lands.
+ *  - Classic is the sequencer's original slide, and the default. Its step grows
+ *    with the distance left, 1 / (1 + time / (1 + distance) / sampleTime), so
+ *    wide intervals don't take much longer than narrow ones.
+ *
+ * Linear, log and exponential take about the given time per volt. Every curve
+ * lands exactly on the target.
+ *
+ * @tparam T is float or simd::float_4.
+ */
+template <typename T>
+class TSlewLimiter
 {
-    float deltaPitch = 0.0f;
-    float out = 0.0f;
-    float ramp = 0.0f;
-    float riseAndFallTime = 0.0f;
-
 public:
-    void setVars(float riseAndFallTime)
+    enum Curve
+    {
+        LINEAR,
+        LOG,
+        EXPONENTIAL,
+        CLASSIC,
+        NUM_CURVES
+    };
+
+    TSlewLimiter() { reset(); }
+
+    void reset()
+    {
+        m_Out = 0.f;
+        m_Velocity = 0.f;
+        m_RiseTime = m_FallTime = m_SampleTime = -1.0f;
+        setTimes(0.0f, 0.0f, 1.0f / 44100.0f);
+    }
+
+    void setCurve(int curve)
+    {
+        m_Curve = curve;
+        m_Velocity = 0.f;
+    }
+    int getCurve() const { return m_Curve; }
+
+    /**
+     * @param riseTime and fallTime are in seconds per volt. 0 is no slew.
+     * @param sampleTime is the engine sample time.
+     */
+    void setTimes(float riseTime, float fallTime, float sampleTime)
+    {
+        if (riseTime == m_RiseTime && fallTime == m_FallTime && sampleTime == m_SampleTime)
+            return;
+
+        m_RiseTime = riseTime;
+        m_FallTime = fallTime;
+        m_SampleTime = sampleTime;
+        m_Rise = Coefficients(riseTime, sampleTime);
+        m_Fall = Coefficients(fallTime, sampleTime);
+    }
+
+    /** Jumps straight to a value, e.g. on reset. */
+    void setValue(T value)
     {
-        this->riseAndFallTime = riseAndFallTime;
+        m_Out = value;
+        m_Velocity = 0.f;
     }
 
-    float process(float in, float sampleRate)
+    T process(T in)
     {
-        if (riseAndFallTime > 0.0f)
+        const T delta = in - m_Out;
+        const auto rising = delta > T(0.0f);
+        const T distance = simd::fmax(delta, -delta);
+
+        T step;
+        switch (m_Curve)
         {
-            deltaPitch = fabsf(in - out);
-            ramp = 1.0f / (1.0f + (riseAndFallTime / (1 + deltaPitch)) * sampleRate);
-
-            if (in > out)
-            {
-                out += ramp;
-                if (out >= in)
-                {
-                    out = in;
-                }
-            }
-            else if (in < out)
-            {
-                out -= ramp;
-                if (out <= in)
-                {
-                    out = in;
-                }
-            }
+        case LOG:
+            step = simd::fmax(distance * simd::ifelse(rising, T(m_Rise.pole), T(m_Fall.pole)),
+                              simd::ifelse(rising, T(m_Rise.minimumStep), T(m_Fall.minimumStep)));
+            break;
+        case EXPONENTIAL:
+            step = simd::fmax(m_Velocity, simd::ifelse(rising, T(m_Rise.startStep), T(m_Fall.startStep)));
+            break;
+        case CLASSIC:
+            /** Never below 1 / (1 + samplesPerVolt), so minimumStep only matters at a time of 0. */
+            step = simd::fmax((1.0f + distance) / (1.0f + distance + simd::ifelse(rising, T(m_Rise.samplesPerVolt), T(m_Fall.samplesPerVolt))),
+                              simd::ifelse(rising, T(m_Rise.minimumStep), T(m_Fall.minimumStep)));
+            break;
+        default:
+            step = simd::ifelse(rising, T(m_Rise.rate), T(m_Fall.rate));
         }
-        else
+
+        const auto landed = distance <= step;
+        m_Out = simd::ifelse(landed, in, simd::ifelse(rising, m_Out + step, m_Out - step));
+        if (m_Curve == EXPONENTIAL)
+            m_Velocity = simd::ifelse(landed, T(0.0f), step * simd::ifelse(rising, T(m_Rise.growth), T(m_Fall.growth)));
+        return m_Out;
+    }
+
+    T getValue() const { return m_Out; }
+
+private:
+    /** Per-sample constants for one direction. */
+    struct Coefficients
+    {
+        float samplesPerVolt = 0.0f;
+        float rate = INFINITY;
+        float pole = 1.0f;
+        float minimumStep = INFINITY;
+        float startStep = INFINITY;
+        float growth = 1.0f;
+
+        Coefficients() {}
+
+        Coefficients(float time, float sampleTime)
         {
-            out = in;
+            if (time <= 0.0f)
+                return;
+
+            /** One sample more than the time takes, so a step is never over a volt. */
+            samplesPerVolt = time / sampleTime;
+            const float samples = 1.0f + samplesPerVolt;
+            rate = 1.0f / samples;
+
+            /** Within 5% of the target after the given time. */
+            pole = 1.0f - std::exp(-3.0f / samples);
+            minimumStep = 0.1f * rate;
+
+            /** Twenty times faster at the end of a volt than at the start. */
+            growth = std::exp(3.0f / samples);
+            startStep = (growth - 1.0f) / (std::exp(3.0f) - 1.0f);
         }
+    };
 
-        return out;
-    }
-};
\ No newline at end of file
+    T m_Out;
+    T m_Velocity;
+    Coefficients m_Rise;
+    Coefficients m_Fall;
+    int m_Curve = CLASSIC;
+    float m_RiseTime;
+    float m_FallTime;
+    float m_SampleTime;
+};
+
+typedef TSlewLimiter<float> SlewLimiter;
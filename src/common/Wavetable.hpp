@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../plugin.hpp"
+
+/**
+ * @class Wavetable
+ * @brief A read-only, band-limited, mipmapped wavetable shared by every module
+ * in the process that plays it.
+ *
+ * The frames are sine, triangle, saw and square, in phase with FMOperatorBank's
+ * shapes, and a morph position from 0 to 3 crossfades between neighbours. Each
+ * frame has one mip level per octave, from 512 harmonics down to one, built by
+ * additive synthesis so none of them alias.
+ *
+ * acquire() hands out a reference-counted pointer to the one table. The first
+ * call starts building it on a worker thread and returns straight away, so
+ * callers must check isReady() and play something else until then. The table
+ * is freed when the last module lets go of it.
+ */
+class Wavetable
+{
+public:
+    static const int SIZE = 2048;
+    static const int NUM_FRAMES = 4;
+    static const int NUM_LEVELS = 10;
+    /** One guard sample before and three after each level, for cubic interpolation. */
+    static const int STRIDE = SIZE + 4;
+
+    static std::shared_ptr<const Wavetable> acquire()
+    {
+        static std::mutex mutex;
+        static std::weak_ptr<Wavetable> shared;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<Wavetable> table = shared.lock();
+        if (!table)
+        {
+            table = std::make_shared<Wavetable>();
+            shared = table;
+            std::thread([table]()
+                        { table->build(); })
+                .detach();
+        }
+        return table;
+    }
+
+    bool isReady() const { return m_Ready.load(std::memory_order_acquire); }
+
+    /** Returns a level of a frame. Index -1 to SIZE + 2 is valid. */
+    const float *get(int frame, int level) const
+    {
+        return &m_Data[(frame * NUM_LEVELS + level) * STRIDE + 1];
+    }
+
+    /**
+     * Returns the first level with no harmonics above Nyquist at a phase
+     * increment. Level L has 512 >> L harmonics, so this is
+     * floor(log2(dt * 1024)) + 1, read from the float's exponent bits.
+     */
+    static int levelFor(float dt)
+    {
+        float x = dt * 1024.0f;
+        int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        int level = ((bits >> 23) & 0xff) - 126;
+        return clamp(level, 0, NUM_LEVELS - 1);
+    }
+
+private:
+    /** Runs on the worker thread. Nothing reads m_Data until m_Ready is set. */
+    void build()
+    {
+        std::vector<float> data(NUM_FRAMES * NUM_LEVELS * STRIDE);
+
+        std::vector<double> sine(SIZE);
+        for (int n = 0; n < SIZE; ++n)
+            sine[n] = std::sin(2.0 * M_PI * n / SIZE);
+
+        std::vector<double> sum(SIZE);
+        for (int frame = 0; frame < NUM_FRAMES; ++frame)
+        {
+            for (int level = 0; level < NUM_LEVELS; ++level)
+            {
+                const int harmonics = std::max(512 >> level, 1);
+                std::fill(sum.begin(), sum.end(), 0.0);
+                for (int k = 1; k <= harmonics; ++k)
+                {
+                    const double amplitude = harmonicAmplitude(frame, k);
+                    if (amplitude == 0.0)
+                        continue;
+                    for (int n = 0; n < SIZE; ++n)
+                        sum[n] += amplitude * sine[(k * n) & (SIZE - 1)];
+                }
+
+                float *out = &data[(frame * NUM_LEVELS + level) * STRIDE];
+                for (int n = 0; n < SIZE; ++n)
+                    out[n + 1] = static_cast<float>(sum[n]);
+                out[0] = out[SIZE];
+                out[SIZE + 1] = out[1];
+                out[SIZE + 2] = out[2];
+                out[SIZE + 3] = out[3];
+            }
+        }
+
+        m_Data.swap(data);
+        m_Ready.store(true, std::memory_order_release);
+    }
+
+    /** Sine series coefficients of the naive shapes. */
+    static double harmonicAmplitude(int frame, int k)
+    {
+        switch (frame)
+        {
+        case 0:
+            return (k == 1) ? 1.0 : 0.0;
+        case 1:
+            return (k % 2) ? ((((k - 1) / 2) % 2) ? -1.0 : 1.0) * 8.0 / (M_PI * M_PI * k * k) : 0.0;
+        case 2:
+            return -2.0 / (M_PI * k);
+        default:
+            return (k % 2) ? 4.0 / (M_PI * k) : 0.0;
+        }
+    }
+
+    std::vector<float> m_Data;
+    std::atomic<bool> m_Ready{false};
+};
@@ -12,6 +12,7 @@ void init(Plugin* p) {
 
 	p->addModel(modelGuideQuant);
 	p->addModel(modelModuleTesting);
+	p->addModel(modelPolyOsc);
 
 	// Any other plugin initialization may go here.
 	// As an alternative, consider lazy-loading assets and lookup tables when your module is created to reduce startup times of Rack.
@@ -11,4 +11,6 @@ extern Plugin* pluginInstance;
 // extern Model* modelMyModule;
 
 extern Model* modelGuideQuant;
+extern Model* modelSemitoneSequencer;
 extern Model* modelModuleTesting;
+extern Model* modelPolyOsc;